@@ -0,0 +1,78 @@
+/**
+ * \file benchAudioread.cpp
+ * \brief Benchmark of ffmpeg.audioread MEX function
+ *
+ * Each scenario reads the entire audio file with
+ *
+ *   [Y, FS] = audioread(FILENAME, DATATYPE)
+ *
+ * (with the 'Threads' & 'Prepass' options of the scenario) and reports the
+ * number of samples per channel as its frame count.
+ */
+
+#include "benchUtils.h"
+
+#include <mex.h>
+
+#include <string>
+#include <vector>
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]);
+
+struct Scenario
+{
+  const char *name;
+  const char *datatype;
+  double threads; // 'Threads' option (1: serial, 0: auto)
+  bool prepass = false;
+};
+
+static const std::vector<Scenario> scenarios = {
+    {"double", "double", 1},
+    {"single", "single", 1},
+    {"int16", "int16", 1},
+    {"native", "native", 1},
+    {"double-parallel", "double", 0},
+    {"double-prepass", "double", 1, true},
+};
+
+int main(int argc, char *argv[])
+{
+  bench::Options opts(argc, argv);
+  bench::Report report(opts);
+
+  for (auto &url : opts.files)
+  {
+    auto pos = url.find_last_of("/\\");
+    std::string file = pos == std::string::npos ? url : url.substr(pos + 1);
+    for (auto &sc : scenarios)
+      report.add(file + ":" + sc.name,
+                 [&](bench::Timer &timer, bench::Result &res) {
+                   mxArray *prhs[] = {mxCreateString(url.c_str()),
+                                      mxCreateString(sc.datatype),
+                                      mxCreateString("Threads"),
+                                      mxCreateDoubleScalar(sc.threads),
+                                      mxCreateString("Prepass"),
+                                      mxCreateLogicalScalar(sc.prepass)};
+                   mxArray *plhs[2] = {nullptr, nullptr};
+                   try
+                   {
+                     mxShimCall(mexFunction, 2, plhs, 6,
+                                (const mxArray **)prhs);
+                   }
+                   catch (...)
+                   {
+                     for (auto *array : prhs) mxDestroyArray(array);
+                     throw;
+                   }
+                   timer.stop();
+
+                   res.frames = mxGetM(plhs[0]);
+                   res.bytes = bench::array_bytes(plhs[0]);
+                   for (auto *array : prhs) mxDestroyArray(array);
+                   for (auto *array : plhs) mxDestroyArray(array);
+                 });
+  }
+
+  return report.finish();
+}
@@ -0,0 +1,57 @@
+/**
+ * \file benchProbe.cpp
+ * \brief Benchmark of ffmpeginfo MEX function (ffmpeg::MxProbe)
+ *
+ * Each scenario probes the media file a number of times with
+ *
+ *   info = ffmpeginfo_mex({FILENAME})
+ *
+ * and reports the number of probes as its frame count.
+ */
+
+#include "benchUtils.h"
+
+#include <mex.h>
+
+#include <string>
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]);
+
+static const int nprobes = 20; // probes per run
+
+int main(int argc, char *argv[])
+{
+  bench::Options opts(argc, argv);
+  bench::Report report(opts);
+
+  for (auto &url : opts.files)
+  {
+    auto pos = url.find_last_of("/\\");
+    std::string file = pos == std::string::npos ? url : url.substr(pos + 1);
+    report.add(file + ":probe", [&](bench::Timer &timer, bench::Result &res) {
+      mxArray *mxFiles = mxCreateCellMatrix(1, 1);
+      mxSetCell(mxFiles, 0, mxCreateString(url.c_str()));
+      const mxArray *prhs[] = {mxFiles};
+      try
+      {
+        for (int i = 0; i < nprobes; ++i)
+        {
+          mxArray *plhs[1] = {nullptr};
+          mxShimCall(mexFunction, 1, plhs, 1, prhs);
+          res.bytes += bench::array_bytes(plhs[0]);
+          ++res.frames;
+          mxDestroyArray(plhs[0]);
+        }
+      }
+      catch (...)
+      {
+        mxDestroyArray(mxFiles);
+        throw;
+      }
+      timer.stop();
+      mxDestroyArray(mxFiles);
+    });
+  }
+
+  return report.finish();
+}
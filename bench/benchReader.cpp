@@ -0,0 +1,197 @@
+/**
+ * \file benchReader.cpp
+ * \brief Benchmark of ffmpeg.Reader MEX backend (decode & convert hot paths)
+ *
+ * Each scenario opens the media file with a set of Reader properties and
+ * reads all the frames with readFrame() as the MATLAB loop
+ *
+ *   while hasFrame(vr), frame = readFrame(vr); end
+ *
+ * does. The reported time includes opening & activating the reader. The
+ * "all-streams" scenarios read every active stream (e.g., video & audio) per
+ * call, so the secondary streams are synchronized to the primary, and the
+ * "hann1024" one returns the audio as 75%-overlapping Hann windows and the
+ * "16k-mono" one resamples & downmixes it in the post-op.
+ */
+
+#include "benchUtils.h"
+
+#include <mex.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]);
+
+struct Scenario
+{
+  const char *name;
+  const char *video_format;
+  const char *video_datatype;
+  double conversion_buffer_size;
+  bool all_streams; // true to output all the active streams
+  const char *audio_layout;
+  const char *audio_format = "";
+  double window_length = 0; // audio windows (0: off)
+  double hop_length = 0;
+  const char *window_function = "rectangular";
+  double sample_rate = 0; // resampled audio (0: native)
+  const char *channel_layout = "";
+};
+
+static const std::vector<Scenario> scenarios = {
+    {"rgb24", "rgb24", "uint8", 0, false, "frames"},
+    {"rgb24+conv4", "rgb24", "uint8", 4, false, "frames"},
+    {"grayscale", "Grayscale", "uint8", 0, false, "frames"},
+    {"rgb24-single", "rgb24", "single", 0, false, "frames"},
+    {"native", "native", "uint8", 0, false, "frames"},
+    {"planes", "planes", "uint8", 0, false, "frames"},
+    {"native-all-streams", "native", "uint8", 0, true, "frames"},
+    {"native-all-streams-contiguous", "native", "uint8", 0, true,
+     "contiguous"},
+    {"native-all-streams-hann1024", "native", "uint8", 0, true, "frames",
+     "flt", 1024, 256, "hann"},
+    {"native-all-streams-16k-mono", "native", "uint8", 0, true, "frames",
+     "flt", 0, 0, "rectangular", 16000, "mono"},
+};
+
+// ffmpeg.Reader object with its default property values
+static mxArray *create_reader(const std::string &url, const Scenario &sc)
+{
+  auto pos = url.find_last_of("/\\");
+  std::string path = pos == std::string::npos ? "" : url.substr(0, pos);
+  std::string name = pos == std::string::npos ? url : url.substr(pos + 1);
+
+  return mxShimCreateObject(
+      "ffmpeg.Reader",
+      {{"backend", mxCreateNumericMatrix(0, 0, mxUINT64_CLASS, mxREAL)},
+       {"Name", mxCreateString(name.c_str())},
+       {"Path", mxCreateString(path.c_str())},
+       {"Streams", mxCreateDoubleMatrix(0, 0, mxREAL)},
+       {"BufferSize", mxCreateDoubleScalar(4)},
+       {"Direction", mxCreateString("forward")},
+       {"FrameSelection", mxCreateString("all")},
+       {"DecodeScale", mxCreateDoubleScalar(1)},
+       {"ReverseCacheSize", mxCreateDoubleScalar(256)},
+       {"ConversionBufferSize",
+        mxCreateDoubleScalar(sc.conversion_buffer_size)},
+       {"StreamBufferSize", mxCreateDoubleScalar(mxGetInf())},
+       {"StreamBufferPolicy", mxCreateString("error")},
+       {"IndexCache", mxCreateString("")},
+       {"CollectStats", mxCreateLogicalScalar(false)},
+       {"DecoderThreads", mxCreateDoubleScalar(0)},
+       {"DecoderThreadType", mxCreateString("auto")},
+       {"VideoFormat", mxCreateString(sc.video_format)},
+       {"VideoDataType", mxCreateString(sc.video_datatype)},
+       {"AudioFormat", mxCreateString(sc.audio_format)},
+       {"AudioLayout", mxCreateString(sc.audio_layout)},
+       {"SampleRate", sc.sample_rate
+                          ? mxCreateDoubleScalar(sc.sample_rate)
+                          : mxCreateDoubleMatrix(0, 0, mxREAL)},
+       {"ChannelLayout", mxCreateString(sc.channel_layout)},
+       {"WindowLength", mxCreateDoubleScalar(sc.window_length)},
+       {"HopLength", mxCreateDoubleScalar(sc.hop_length)},
+       {"WindowFunction", mxCreateString(sc.window_function)},
+       {"FilterGraph", mxCreateString("")}});
+}
+
+// call the backend: [plhs{1:nlhs}] = mex_backend(obj, action)
+static void call(mxArray *obj, const char *action, int nlhs, mxArray *plhs[])
+{
+  mxArray *mxAction = mxCreateString(action);
+  const mxArray *prhs[] = {obj, mxAction};
+  try
+  {
+    mxShimCall(mexFunction, nlhs, plhs, 2, prhs);
+  }
+  catch (...)
+  {
+    mxDestroyArray(mxAction);
+    throw;
+  }
+  mxDestroyArray(mxAction);
+}
+
+static mxArray *call(mxArray *obj, const char *action, int nlhs = 0)
+{
+  mxArray *plhs[1] = {nullptr};
+  call(obj, action, nlhs, plhs);
+  return plhs[0];
+}
+
+static void run(mxArray *obj, const std::string &url, const Scenario &sc,
+                bench::Timer &timer, bench::Result &res)
+{
+  // construct the backend: mex_backend(obj, url)
+  mxArray *mxURL = mxCreateString(url.c_str());
+  const mxArray *prhs[] = {obj, mxURL};
+  mxShimCall(mexFunction, 0, nullptr, 2, prhs);
+  mxDestroyArray(mxURL);
+
+  try
+  {
+    call(obj, "activate");
+
+    int nout = 1;
+    if (sc.all_streams)
+    {
+      mxArray *mxStreams = mxGetProperty(obj, 0, "Streams");
+      nout = std::max(1, (int)mxGetNumberOfElements(mxStreams));
+      mxDestroyArray(mxStreams);
+    }
+    std::vector<mxArray *> outs(nout);
+
+    for (;;)
+    {
+      mxArray *mxTF = call(obj, "hasFrame", 1);
+      bool tf = mxIsLogicalScalarTrue(mxTF);
+      mxDestroyArray(mxTF);
+      if (!tf) break;
+
+      call(obj, "readFrame", nout, outs.data());
+      for (auto *out : outs)
+      {
+        res.bytes += bench::array_bytes(out);
+        mxDestroyArray(out);
+      }
+      ++res.frames;
+    }
+    timer.stop();
+  }
+  catch (...)
+  {
+    call(obj, "delete");
+    throw;
+  }
+  call(obj, "delete");
+}
+
+int main(int argc, char *argv[])
+{
+  bench::Options opts(argc, argv);
+  bench::Report report(opts);
+
+  for (auto &url : opts.files)
+  {
+    auto pos = url.find_last_of("/\\");
+    std::string file = pos == std::string::npos ? url : url.substr(pos + 1);
+    for (auto &sc : scenarios)
+      report.add(file + ":" + sc.name,
+                 [&](bench::Timer &timer, bench::Result &res) {
+                   mxArray *obj = create_reader(url, sc);
+                   try
+                   {
+                     run(obj, url, sc, timer, res);
+                   }
+                   catch (...)
+                   {
+                     mxDestroyArray(obj);
+                     throw;
+                   }
+                   mxDestroyArray(obj);
+                 });
+  }
+
+  return report.finish();
+}
@@ -0,0 +1,172 @@
+#include "benchUtils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <new>
+#include <sstream>
+
+// count all the heap allocations of the process
+static std::atomic<size_t> heap_allocs(0);
+static std::atomic<size_t> heap_bytes(0);
+
+void *operator new(std::size_t n)
+{
+  heap_allocs.fetch_add(1, std::memory_order_relaxed);
+  heap_bytes.fetch_add(n, std::memory_order_relaxed);
+  if (void *p = std::malloc(n ? n : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t n) { return operator new(n); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+namespace bench
+{
+
+HeapStats getHeapStats() { return {heap_allocs.load(), heap_bytes.load()}; }
+
+Timer::Timer()
+    : seconds(0.0), heap_allocs(0), mx_allocs(0), mx_peak(0),
+      heap0(getHeapStats())
+{
+  t0 = std::chrono::steady_clock::now(); // last to exclude the setup
+}
+
+void Timer::stop()
+{
+  auto t1 = std::chrono::steady_clock::now();
+  seconds = std::chrono::duration<double>(t1 - t0).count();
+  heap_allocs = getHeapStats().allocs - heap0.allocs;
+  mxShimStats mx = mxShimGetStats();
+  mx_allocs = mx.allocs;
+  mx_peak = mx.peak;
+}
+
+Options::Options(int argc, char *argv[])
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg(argv[i]);
+    auto value = [&]() -> std::string {
+      if (++i == argc)
+      {
+        std::fprintf(stderr, "%s: missing value of %s\n", argv[0],
+                     arg.c_str());
+        std::exit(2);
+      }
+      return argv[i];
+    };
+
+    if (arg == "--repeat")
+      repeat = std::max(1, std::atoi(value().c_str()));
+    else if (arg == "--save")
+      save = value();
+    else if (arg == "--compare")
+      compare = value();
+    else if (arg == "--tolerance")
+      tolerance = std::atof(value().c_str());
+    else if (arg.compare(0, 2, "--") == 0)
+    {
+      std::fprintf(stderr,
+                   "usage: %s [--repeat N] [--save FILE] [--compare FILE] "
+                   "[--tolerance PCT] MEDIA_FILE...\n",
+                   argv[0]);
+      std::exit(2);
+    }
+    else
+      files.push_back(arg);
+  }
+}
+
+void Report::print(const Result &res)
+{
+  if (results.empty() && !nfailed)
+    std::printf("%-48s %8s %10s %10s %10s %10s %12s\n", "scenario", "frames",
+                "frames/s", "MB/s", "new/frame", "mx/frame", "mx peak [MB]");
+
+  double n = res.frames ? (double)res.frames : 1.0;
+  std::printf("%-48s %8zu %10.1f %10.1f %10.2f %10.2f %12.2f\n",
+              res.name.c_str(), res.frames, res.fps(), res.mbps(),
+              res.heap_allocs / n, res.mx_allocs / n, res.mx_peak / 1e6);
+  std::fflush(stdout);
+}
+
+void Report::failed(const std::string &name, const char *msg)
+{
+  std::printf("%-48s FAILED: %s\n", name.c_str(), msg);
+  ++nfailed;
+}
+
+int Report::finish()
+{
+  int rval = nfailed ? 1 : 0;
+
+  if (opts.compare.size())
+  {
+    std::ifstream is(opts.compare);
+    if (!is)
+    {
+      std::fprintf(stderr, "Failed to open the baseline: %s\n",
+                   opts.compare.c_str());
+      return 2;
+    }
+
+    // scenario -> frames/s
+    std::map<std::string, double> baseline;
+    std::string line;
+    while (std::getline(is, line))
+    {
+      std::istringstream ls(line);
+      std::string name;
+      double fps;
+      if (std::getline(ls, name, '\t') && ls >> fps) baseline[name] = fps;
+    }
+
+    std::printf("\n%-48s %10s %10s %8s\n", "scenario", "baseline", "frames/s",
+                "change");
+    for (auto &res : results)
+    {
+      auto it = baseline.find(res.name);
+      if (it == baseline.end() || it->second <= 0.0) continue;
+      double change = 100.0 * (res.fps() / it->second - 1.0);
+      bool regressed = change < -opts.tolerance;
+      std::printf("%-48s %10.1f %10.1f %+7.1f%%%s\n", res.name.c_str(),
+                  it->second, res.fps(), change,
+                  regressed ? "  REGRESSION" : "");
+      if (regressed) rval = 1;
+    }
+  }
+
+  if (opts.save.size())
+  {
+    std::ofstream os(opts.save);
+    for (auto &res : results)
+      os << res.name << '\t' << res.fps() << '\t' << res.mbps() << '\t'
+         << res.heap_allocs << '\t' << res.mx_allocs << '\t' << res.mx_peak
+         << '\n';
+    if (!os)
+    {
+      std::fprintf(stderr, "Failed to save the results: %s\n",
+                   opts.save.c_str());
+      return 2;
+    }
+  }
+
+  return rval;
+}
+
+double array_bytes(const mxArray *array)
+{
+  if (!array || mxIsStruct(array) || mxIsCell(array)) return 0.0;
+  return (double)mxGetNumberOfElements(array) * mxGetElementSize(array) *
+         (mxIsComplex(array) ? 2 : 1);
+}
+
+} // namespace bench
@@ -0,0 +1,151 @@
+#pragma once
+
+/**
+ * \file benchUtils.h
+ * \brief Timing, allocation counting, and reporting shared by the benchmarks
+ */
+
+#include <mex.h>
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace bench
+{
+
+/**
+ * \brief Counters of the heap allocations made via global operator new
+ */
+struct HeapStats
+{
+  size_t allocs; // number of operator new calls
+  size_t bytes;  // total bytes requested by them
+};
+HeapStats getHeapStats();
+
+/**
+ * \brief Measures one run of a scenario
+ *
+ * Construct it right before the timed section and call stop() right after.
+ * Both the heap (operator new) and the mx allocations made in between are
+ * counted.
+ */
+class Timer
+{
+  public:
+  Timer();
+  void stop();
+
+  double seconds;     // elapsed wall time
+  size_t heap_allocs; // operator new calls
+  size_t mx_allocs;   // mxMalloc/mxCalloc/mxRealloc calls
+  size_t mx_peak;     // high-water mark of the live mx memory in bytes
+
+  private:
+  std::chrono::steady_clock::time_point t0;
+  HeapStats heap0;
+};
+
+/**
+ * \brief Result of a scenario
+ */
+struct Result
+{
+  std::string name;   // "<media file>:<scenario>"
+  size_t frames;      // frames (or audio samples per channel) read
+  double bytes;       // bytes of the mxArray outputs
+  double seconds;     // best elapsed time of the repeated runs
+  size_t heap_allocs; // of the best run
+  size_t mx_allocs;   // of the best run
+  size_t mx_peak;     // of the best run
+
+  double fps() const { return seconds > 0.0 ? frames / seconds : 0.0; }
+  double mbps() const { return seconds > 0.0 ? bytes / seconds / 1e6 : 0.0; }
+};
+
+/**
+ * \brief Command-line options common to the benchmarks
+ *
+ *   bench_exe [--repeat N] [--save FILE] [--compare FILE] [--tolerance PCT]
+ *             MEDIA_FILE...
+ */
+struct Options
+{
+  std::vector<std::string> files;
+  int repeat = 3;          // runs per scenario (best one is reported)
+  std::string save;        // TSV file to save the results to
+  std::string compare;     // TSV file with the baseline results
+  double tolerance = 10.0; // allowed slow-down in percent against baseline
+
+  Options(int argc, char *argv[]);
+};
+
+/**
+ * \brief Collects the results and reports them
+ */
+class Report
+{
+  public:
+  Report(const Options &opts) : opts(opts) {}
+
+  /**
+   * \brief Run a scenario opts.repeat times and keep the fastest run
+   *
+   * \param[in] name Scenario name
+   * \param[in] run  Callable with signature void(Timer&, Result&) which
+   *                 stops the timer and fills frames & bytes of the result
+   * \returns false if the scenario failed (the error is printed)
+   */
+  template <typename Run> bool add(const std::string &name, Run run)
+  {
+    Result best{name, 0, 0.0, -1.0, 0, 0, 0};
+    for (int i = 0; i < opts.repeat; ++i)
+    {
+      Result res{name, 0, 0.0, 0.0, 0, 0, 0};
+      try
+      {
+        mxShimResetStats();
+        Timer timer;
+        run(timer, res);
+        res.seconds = timer.seconds;
+        res.heap_allocs = timer.heap_allocs;
+        res.mx_allocs = timer.mx_allocs;
+        res.mx_peak = timer.mx_peak;
+      }
+      catch (const std::exception &e)
+      {
+        failed(name, e.what());
+        return false;
+      }
+      if (best.seconds < 0.0 || res.seconds < best.seconds) best = res;
+    }
+    print(best);
+    results.push_back(best);
+    return true;
+  }
+
+  /**
+   * \brief Save and/or compare the results as requested by the options
+   *
+   * \returns the process exit code: nonzero if any scenario failed or ran
+   *          slower than the baseline beyond the tolerance
+   */
+  int finish();
+
+  private:
+  void print(const Result &res);
+  void failed(const std::string &name, const char *msg);
+
+  const Options &opts;
+  std::vector<Result> results;
+  int nfailed = 0;
+};
+
+/**
+ * \brief Bytes of the data of an mxArray (0 if not numeric/char/logical)
+ */
+double array_bytes(const mxArray *array);
+
+} // namespace bench
@@ -0,0 +1,232 @@
+#pragma once
+
+/**
+ * \file mex.h
+ * \brief Thin stand-in of the MATLAB MEX/MX C API for the native benchmarks
+ *
+ * Implements the subset of the API used by the backends (numeric, char,
+ * logical, struct, and cell arrays in column-major order plus the property
+ * bags of MATLAB objects), so that the backend sources can be compiled and
+ * linked as they are outside of MATLAB and run under perf, valgrind, or the
+ * sanitizers. mexErrMsgIdAndTxt() throws mxShimError.
+ *
+ * mx memory allocations are tracked (see mxShimStats). As in MATLAB, the
+ * arrays and the mx memory created during a mxShimCall() are released when
+ * the call returns unless they are returned, stored in another array, or
+ * made persistent. mexCallMATLAB() dispatches to the functions registered
+ * with mxShimRegisterFunction() ("which" is built in).
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+typedef struct mxArray_tag mxArray;
+typedef size_t mwSize;
+typedef size_t mwIndex;
+typedef char16_t mxChar;
+typedef bool mxLogical;
+
+typedef enum
+{
+  mxUNKNOWN_CLASS = 0,
+  mxCELL_CLASS,
+  mxSTRUCT_CLASS,
+  mxLOGICAL_CLASS,
+  mxCHAR_CLASS,
+  mxVOID_CLASS,
+  mxDOUBLE_CLASS,
+  mxSINGLE_CLASS,
+  mxINT8_CLASS,
+  mxUINT8_CLASS,
+  mxINT16_CLASS,
+  mxUINT16_CLASS,
+  mxINT32_CLASS,
+  mxUINT32_CLASS,
+  mxINT64_CLASS,
+  mxUINT64_CLASS,
+  mxFUNCTION_CLASS,
+  mxOPAQUE_CLASS,
+  mxOBJECT_CLASS
+} mxClassID;
+
+typedef enum
+{
+  mxREAL,
+  mxCOMPLEX
+} mxComplexity;
+
+// memory
+void *mxMalloc(size_t n);
+void *mxCalloc(size_t n, size_t size);
+void *mxRealloc(void *ptr, size_t n);
+void mxFree(void *ptr);
+void mexMakeMemoryPersistent(void *ptr);
+void mexMakeArrayPersistent(mxArray *array);
+
+// creation & destruction
+mxArray *mxCreateNumericArray(mwSize ndim, const mwSize *dims,
+                              mxClassID classid, mxComplexity flag);
+mxArray *mxCreateNumericMatrix(mwSize m, mwSize n, mxClassID classid,
+                               mxComplexity flag);
+mxArray *mxCreateUninitNumericArray(mwSize ndim, const mwSize *dims,
+                                    mxClassID classid, mxComplexity flag);
+mxArray *mxCreateUninitNumericMatrix(mwSize m, mwSize n, mxClassID classid,
+                                     mxComplexity flag);
+mxArray *mxCreateDoubleMatrix(mwSize m, mwSize n, mxComplexity flag);
+mxArray *mxCreateDoubleScalar(double value);
+mxArray *mxCreateLogicalScalar(bool value);
+mxArray *mxCreateString(const char *str);
+mxArray *mxCreateStructMatrix(mwSize m, mwSize n, int nfields,
+                              const char **fieldnames);
+mxArray *mxCreateCellMatrix(mwSize m, mwSize n);
+mxArray *mxDuplicateArray(const mxArray *in);
+void mxDestroyArray(mxArray *array);
+
+// inquiry
+mxClassID mxGetClassID(const mxArray *array);
+const char *mxGetClassName(const mxArray *array);
+bool mxIsClass(const mxArray *array, const char *name);
+bool mxIsNumeric(const mxArray *array);
+bool mxIsDouble(const mxArray *array);
+bool mxIsSingle(const mxArray *array);
+bool mxIsLogical(const mxArray *array);
+bool mxIsChar(const mxArray *array);
+bool mxIsStruct(const mxArray *array);
+bool mxIsCell(const mxArray *array);
+bool mxIsComplex(const mxArray *array);
+bool mxIsEmpty(const mxArray *array);
+bool mxIsScalar(const mxArray *array);
+bool mxIsLogicalScalarTrue(const mxArray *array);
+size_t mxGetElementSize(const mxArray *array);
+size_t mxGetNumberOfElements(const mxArray *array);
+mwSize mxGetNumberOfDimensions(const mxArray *array);
+const mwSize *mxGetDimensions(const mxArray *array);
+int mxSetDimensions(mxArray *array, const mwSize *dims, mwSize ndim);
+size_t mxGetM(const mxArray *array);
+size_t mxGetN(const mxArray *array);
+void mxSetM(mxArray *array, size_t m);
+void mxSetN(mxArray *array, size_t n);
+
+// data
+void *mxGetData(const mxArray *array);
+void mxSetData(mxArray *array, void *data);
+void mxSetPr(mxArray *array, double *pr);
+double *mxGetPr(const mxArray *array);
+mxLogical *mxGetLogicals(const mxArray *array);
+mxChar *mxGetChars(const mxArray *array);
+double mxGetScalar(const mxArray *array);
+double mxGetNaN(void);
+double mxGetInf(void);
+int mxGetString(const mxArray *array, char *buf, mwSize buflen);
+char *mxArrayToString(const mxArray *array);
+char *mxArrayToUTF8String(const mxArray *array);
+
+// struct & cell
+int mxGetNumberOfFields(const mxArray *array);
+const char *mxGetFieldNameByNumber(const mxArray *array, int n);
+int mxGetFieldNumber(const mxArray *array, const char *name);
+int mxAddField(mxArray *array, const char *name);
+void mxRemoveField(mxArray *array, int n);
+mxArray *mxGetField(const mxArray *array, mwIndex i, const char *name);
+mxArray *mxGetFieldByNumber(const mxArray *array, mwIndex i, int n);
+void mxSetField(mxArray *array, mwIndex i, const char *name, mxArray *value);
+void mxSetFieldByNumber(mxArray *array, mwIndex i, int n, mxArray *value);
+mxArray *mxGetCell(const mxArray *array, mwIndex i);
+void mxSetCell(mxArray *array, mwIndex i, mxArray *value);
+
+// MATLAB objects
+mxArray *mxGetProperty(const mxArray *obj, mwIndex i, const char *name);
+void mxSetProperty(mxArray *obj, mwIndex i, const char *name,
+                   const mxArray *value);
+
+// MEX
+int mexPrintf(const char *fmt, ...);
+[[noreturn]] void mexErrMsgTxt(const char *msg);
+[[noreturn]] void mexErrMsgIdAndTxt(const char *id, const char *fmt, ...);
+void mexWarnMsgTxt(const char *msg);
+void mexWarnMsgIdAndTxt(const char *id, const char *fmt, ...);
+int mexCallMATLAB(int nlhs, mxArray *plhs[], int nrhs, mxArray *prhs[],
+                  const char *name);
+void mexLock(void);
+void mexUnlock(void);
+
+/**
+ * \brief Exception thrown in place of MATLAB error by mexErrMsgIdAndTxt()
+ */
+class mxShimError : public std::runtime_error
+{
+  public:
+  mxShimError(const std::string &id, const std::string &msg)
+      : std::runtime_error(msg), id_(id)
+  {
+  }
+  const std::string &id() const { return id_; }
+
+  private:
+  std::string id_;
+};
+
+/**
+ * \brief Counters of the mx memory allocations
+ */
+struct mxShimStats
+{
+  size_t allocs;   // number of mxMalloc/mxCalloc/mxRealloc calls
+  size_t bytes;    // total bytes requested by them
+  size_t live;     // bytes currently allocated
+  size_t peak;     // high-water mark of live
+  size_t arrays;   // number of mxArrays currently alive
+  size_t locks;    // mexLock() count (i.e., live MEX object handles)
+};
+mxShimStats mxShimGetStats();
+
+/**
+ * \brief Reset allocs, bytes, and peak (live, arrays, and locks are kept)
+ */
+void mxShimResetStats();
+
+/**
+ * \brief Get the number of live mx memory blocks, optionally with their
+ *        addresses & sizes (to report leaks)
+ */
+size_t
+mxShimGetLiveBlocks(std::vector<std::pair<void *, size_t>> *list = nullptr);
+
+/**
+ * \brief Create a scalar MATLAB object with the given properties
+ *
+ * The property values are taken over by the object.
+ */
+mxArray *
+mxShimCreateObject(const char *classname,
+                   std::initializer_list<std::pair<const char *, mxArray *>>
+                       props);
+
+/**
+ * \brief MATLAB function called by mexCallMATLAB()
+ */
+typedef std::function<void(int nlhs, mxArray *plhs[], int nrhs,
+                           mxArray *prhs[])>
+    mxShimFunction;
+
+/**
+ * \brief Make a MATLAB function available to mexCallMATLAB() (an empty
+ *        fcn removes it)
+ */
+void mxShimRegisterFunction(const char *name, mxShimFunction fcn);
+
+/**
+ * \brief Call a mexFunction as MATLAB would: the temporary arrays created
+ *        during the call (but not returned nor stored in another array) are
+ *        destroyed when it returns (or throws)
+ */
+void mxShimCall(void (*fcn)(int, mxArray *[], int, const mxArray *[]),
+                int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]);
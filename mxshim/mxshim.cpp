@@ -0,0 +1,695 @@
+#include "mex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct mxArray_tag
+{
+  mxClassID cls = mxDOUBLE_CLASS;
+  bool complex = false;
+  std::vector<mwSize> dims = {0, 0};
+  void *data = nullptr; // numeric, logical, or char elements (mx-allocated)
+
+  std::vector<std::string> fields; // struct field names
+  std::vector<mxArray *> elems;     // struct (nel x nfields) or cell elements
+
+  std::string classname;                 // object class name
+  std::map<std::string, mxArray *> props; // object properties
+};
+
+namespace
+{
+
+mxShimStats stats = {0, 0, 0, 0, 0, 0};
+std::unordered_map<void *, size_t> blocks; // live mx allocations & sizes
+
+bool in_call = false;                 // true while in mxShimCall()
+std::unordered_set<mxArray *> temps;  // arrays to be destroyed after the call
+std::unordered_set<void *> temp_blocks; // mx memory to be freed after the call
+
+// MATLAB functions available to mexCallMATLAB()
+std::map<std::string, mxShimFunction> &functions()
+{
+  static std::map<std::string, mxShimFunction> fcns = {
+      // which(FILE): the path if the file exists, else ''
+      {"which", [](int nlhs, mxArray *plhs[], int nrhs, mxArray *prhs[]) {
+         if (nrhs != 1 || !mxIsChar(prhs[0]))
+           mexErrMsgIdAndTxt("mxshim:which:invalidInput",
+                             "which() takes one char array argument.");
+         char *path = mxArrayToString(prhs[0]);
+         struct stat st;
+         bool found = !stat(path, &st);
+         if (nlhs > 0) plhs[0] = mxCreateString(found ? path : "");
+         mxFree(path);
+       }}};
+  return fcns;
+}
+
+void track(void *ptr, const size_t n)
+{
+  ++stats.allocs;
+  stats.bytes += n;
+  stats.live += n;
+  if (stats.live > stats.peak) stats.peak = stats.live;
+  blocks[ptr] = n;
+  if (in_call) temp_blocks.insert(ptr);
+}
+
+void untrack(void *ptr)
+{
+  auto it = blocks.find(ptr);
+  if (it == blocks.end()) return;
+  stats.live -= it->second;
+  blocks.erase(it);
+  temp_blocks.erase(ptr);
+}
+
+// allocate the data of an array, whose lifetime is tied to the array
+void *alloc_data(const size_t n, const bool init)
+{
+  void *data = init ? mxCalloc(n, 1) : mxMalloc(n);
+  temp_blocks.erase(data);
+  return data;
+}
+
+size_t get_element_size(const mxClassID cls)
+{
+  switch (cls)
+  {
+  case mxLOGICAL_CLASS:
+  case mxINT8_CLASS:
+  case mxUINT8_CLASS: return 1;
+  case mxCHAR_CLASS:
+  case mxINT16_CLASS:
+  case mxUINT16_CLASS: return 2;
+  case mxSINGLE_CLASS:
+  case mxINT32_CLASS:
+  case mxUINT32_CLASS: return 4;
+  case mxDOUBLE_CLASS:
+  case mxINT64_CLASS:
+  case mxUINT64_CLASS: return 8;
+  default: return 0;
+  }
+}
+
+size_t get_numel(const mxArray *array)
+{
+  size_t n = 1;
+  for (auto d : array->dims) n *= d;
+  return n;
+}
+
+mxArray *create(const mxClassID cls, const mwSize m, const mwSize n)
+{
+  mxArray *array = new mxArray_tag;
+  array->cls = cls;
+  array->dims = {m, n};
+  ++stats.arrays;
+  if (in_call) temps.insert(array);
+  return array;
+}
+
+mxArray *create_numeric(mwSize ndim, const mwSize *dims, mxClassID cls,
+                        const bool init)
+{
+  mxArray *array = create(cls, 0, 0);
+  array->dims.assign(dims, dims + ndim);
+  while (array->dims.size() < 2) array->dims.push_back(1);
+  size_t n = get_numel(array) * get_element_size(cls);
+  if (n) array->data = alloc_data(n, init);
+  return array;
+}
+
+// take the array over as a child of another array
+mxArray *adopt(mxArray *array)
+{
+  if (array) temps.erase(array);
+  return array;
+}
+
+[[noreturn]] void throw_error(const char *id, const char *fmt, va_list args)
+{
+  char msg[4096];
+  std::vsnprintf(msg, sizeof(msg), fmt, args);
+  throw mxShimError(id ? id : "", msg);
+}
+
+const char *builtin_classname(const mxClassID cls)
+{
+  static const char *names[] = {
+      "unknown", "cell",  "struct", "logical", "char",   "void",   "double",
+      "single",  "int8",  "uint8",  "int16",   "uint16", "int32",  "uint32",
+      "int64",   "uint64", "function_handle", "opaque", "object"};
+  return names[cls];
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+// memory
+
+void *mxMalloc(size_t n)
+{
+  void *ptr = std::malloc(n ? n : 1);
+  if (!ptr) mexErrMsgIdAndTxt("mxshim:OutOfMemory", "Out of memory.");
+  track(ptr, n);
+  return ptr;
+}
+
+void *mxCalloc(size_t n, size_t size)
+{
+  void *ptr = std::calloc(n ? n : 1, size ? size : 1);
+  if (!ptr) mexErrMsgIdAndTxt("mxshim:OutOfMemory", "Out of memory.");
+  track(ptr, n * size);
+  return ptr;
+}
+
+void *mxRealloc(void *ptr, size_t n)
+{
+  // keep the persistence of the original block
+  bool temp = !ptr ? in_call : temp_blocks.count(ptr) > 0;
+  untrack(ptr);
+  void *p = std::realloc(ptr, n ? n : 1);
+  if (!p) mexErrMsgIdAndTxt("mxshim:OutOfMemory", "Out of memory.");
+  track(p, n);
+  if (!temp) temp_blocks.erase(p);
+  return p;
+}
+
+void mxFree(void *ptr)
+{
+  if (!ptr) return;
+  untrack(ptr);
+  std::free(ptr);
+}
+
+void mexMakeMemoryPersistent(void *ptr) { temp_blocks.erase(ptr); }
+
+void mexMakeArrayPersistent(mxArray *array) { temps.erase(array); }
+
+mxShimStats mxShimGetStats() { return stats; }
+
+size_t mxShimGetLiveBlocks(std::vector<std::pair<void *, size_t>> *list)
+{
+  if (list) list->assign(blocks.begin(), blocks.end());
+  return blocks.size();
+}
+
+void mxShimResetStats()
+{
+  stats.allocs = stats.bytes = 0;
+  stats.peak = stats.live;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// creation & destruction
+
+mxArray *mxCreateNumericArray(mwSize ndim, const mwSize *dims,
+                              mxClassID classid, mxComplexity)
+{
+  return create_numeric(ndim, dims, classid, true);
+}
+
+mxArray *mxCreateNumericMatrix(mwSize m, mwSize n, mxClassID classid,
+                               mxComplexity flag)
+{
+  mwSize dims[2] = {m, n};
+  return mxCreateNumericArray(2, dims, classid, flag);
+}
+
+mxArray *mxCreateUninitNumericArray(mwSize ndim, const mwSize *dims,
+                                    mxClassID classid, mxComplexity)
+{
+  return create_numeric(ndim, dims, classid, false);
+}
+
+mxArray *mxCreateUninitNumericMatrix(mwSize m, mwSize n, mxClassID classid,
+                                     mxComplexity flag)
+{
+  mwSize dims[2] = {m, n};
+  return mxCreateUninitNumericArray(2, dims, classid, flag);
+}
+
+mxArray *mxCreateDoubleMatrix(mwSize m, mwSize n, mxComplexity flag)
+{
+  return mxCreateNumericMatrix(m, n, mxDOUBLE_CLASS, flag);
+}
+
+mxArray *mxCreateDoubleScalar(double value)
+{
+  mxArray *array = mxCreateUninitNumericMatrix(1, 1, mxDOUBLE_CLASS, mxREAL);
+  *(double *)array->data = value;
+  return array;
+}
+
+mxArray *mxCreateLogicalScalar(bool value)
+{
+  mxArray *array = mxCreateUninitNumericMatrix(1, 1, mxLOGICAL_CLASS, mxREAL);
+  *(mxLogical *)array->data = value;
+  return array;
+}
+
+mxArray *mxCreateString(const char *str)
+{
+  size_t n = std::strlen(str);
+  mwSize dims[2] = {n ? 1u : 0u, n};
+  mxArray *array = create_numeric(2, dims, mxCHAR_CLASS, false);
+  mxChar *chars = (mxChar *)array->data;
+  for (size_t i = 0; i < n; ++i) chars[i] = (unsigned char)str[i];
+  return array;
+}
+
+mxArray *mxCreateStructMatrix(mwSize m, mwSize n, int nfields,
+                              const char **fieldnames)
+{
+  mxArray *array = create(mxSTRUCT_CLASS, m, n);
+  array->fields.assign(fieldnames, fieldnames + nfields);
+  array->elems.assign(m * n * nfields, nullptr);
+  return array;
+}
+
+mxArray *mxCreateCellMatrix(mwSize m, mwSize n)
+{
+  mxArray *array = create(mxCELL_CLASS, m, n);
+  array->elems.assign(m * n, nullptr);
+  return array;
+}
+
+mxArray *mxDuplicateArray(const mxArray *in)
+{
+  mxArray *array = create(in->cls, 0, 0);
+  array->complex = in->complex;
+  array->dims = in->dims;
+  array->fields = in->fields;
+  array->classname = in->classname;
+  if (in->data)
+  {
+    size_t n = get_numel(in) * get_element_size(in->cls);
+    array->data = alloc_data(n, false);
+    std::memcpy(array->data, in->data, n);
+  }
+  for (auto *e : in->elems)
+    array->elems.push_back(e ? adopt(mxDuplicateArray(e)) : nullptr);
+  for (auto &p : in->props)
+    array->props[p.first] = adopt(mxDuplicateArray(p.second));
+  return array;
+}
+
+void mxDestroyArray(mxArray *array)
+{
+  if (!array) return;
+  temps.erase(array);
+  mxFree(array->data);
+  for (auto *e : array->elems) mxDestroyArray(e);
+  for (auto &p : array->props) mxDestroyArray(p.second);
+  delete array;
+  --stats.arrays;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// inquiry
+
+mxClassID mxGetClassID(const mxArray *array)
+{
+  return array->classname.size() ? mxOBJECT_CLASS : array->cls;
+}
+
+const char *mxGetClassName(const mxArray *array)
+{
+  return array->classname.size() ? array->classname.c_str()
+                                 : builtin_classname(array->cls);
+}
+
+bool mxIsClass(const mxArray *array, const char *name)
+{
+  return !std::strcmp(mxGetClassName(array), name);
+}
+
+bool mxIsNumeric(const mxArray *array)
+{
+  return array->classname.empty() && array->cls >= mxDOUBLE_CLASS &&
+         array->cls <= mxUINT64_CLASS;
+}
+
+bool mxIsDouble(const mxArray *array) { return mxIsClass(array, "double"); }
+bool mxIsSingle(const mxArray *array) { return mxIsClass(array, "single"); }
+bool mxIsLogical(const mxArray *array) { return mxIsClass(array, "logical"); }
+bool mxIsChar(const mxArray *array) { return mxIsClass(array, "char"); }
+bool mxIsStruct(const mxArray *array) { return mxIsClass(array, "struct"); }
+bool mxIsCell(const mxArray *array) { return mxIsClass(array, "cell"); }
+bool mxIsComplex(const mxArray *array) { return array->complex; }
+bool mxIsEmpty(const mxArray *array) { return !get_numel(array); }
+bool mxIsScalar(const mxArray *array) { return get_numel(array) == 1; }
+
+bool mxIsLogicalScalarTrue(const mxArray *array)
+{
+  return mxIsLogical(array) && mxIsScalar(array) && *(mxLogical *)array->data;
+}
+
+size_t mxGetElementSize(const mxArray *array)
+{
+  return get_element_size(array->cls);
+}
+
+size_t mxGetNumberOfElements(const mxArray *array) { return get_numel(array); }
+
+mwSize mxGetNumberOfDimensions(const mxArray *array)
+{
+  return array->dims.size();
+}
+
+const mwSize *mxGetDimensions(const mxArray *array)
+{
+  return array->dims.data();
+}
+
+int mxSetDimensions(mxArray *array, const mwSize *dims, mwSize ndim)
+{
+  array->dims.assign(dims, dims + ndim);
+  while (array->dims.size() < 2) array->dims.push_back(1);
+  while (array->dims.size() > 2 && array->dims.back() == 1)
+    array->dims.pop_back();
+  return 0;
+}
+
+size_t mxGetM(const mxArray *array) { return array->dims[0]; }
+
+size_t mxGetN(const mxArray *array)
+{
+  // product of the trailing dimensions (not numel/M, which fails if M = 0)
+  size_t n = 1;
+  for (size_t i = 1; i < array->dims.size(); ++i) n *= array->dims[i];
+  return n;
+}
+
+void mxSetM(mxArray *array, size_t m) { array->dims[0] = m; }
+
+void mxSetN(mxArray *array, size_t n)
+{
+  array->dims.resize(2);
+  array->dims[1] = n;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// data
+
+void *mxGetData(const mxArray *array)
+{
+  // cell elements are exposed as an mxArray* array as MATLAB does
+  if (array->cls == mxCELL_CLASS) return (void *)array->elems.data();
+  return array->data;
+}
+
+void mxSetData(mxArray *array, void *data)
+{
+  if (array->data != data) mxFree(array->data);
+  array->data = data;
+  temp_blocks.erase(data); // now owned by the array
+}
+
+void mxSetPr(mxArray *array, double *pr) { mxSetData(array, pr); }
+
+double *mxGetPr(const mxArray *array) { return (double *)array->data; }
+
+mxLogical *mxGetLogicals(const mxArray *array)
+{
+  return (mxLogical *)array->data;
+}
+
+mxChar *mxGetChars(const mxArray *array) { return (mxChar *)array->data; }
+
+double mxGetScalar(const mxArray *array)
+{
+  if (!array->data) return 0.0;
+  switch (array->cls)
+  {
+  case mxLOGICAL_CLASS: return *(mxLogical *)array->data;
+  case mxCHAR_CLASS: return *(mxChar *)array->data;
+  case mxDOUBLE_CLASS: return *(double *)array->data;
+  case mxSINGLE_CLASS: return *(float *)array->data;
+  case mxINT8_CLASS: return *(int8_t *)array->data;
+  case mxUINT8_CLASS: return *(uint8_t *)array->data;
+  case mxINT16_CLASS: return *(int16_t *)array->data;
+  case mxUINT16_CLASS: return *(uint16_t *)array->data;
+  case mxINT32_CLASS: return *(int32_t *)array->data;
+  case mxUINT32_CLASS: return *(uint32_t *)array->data;
+  case mxINT64_CLASS: return (double)*(int64_t *)array->data;
+  case mxUINT64_CLASS: return (double)*(uint64_t *)array->data;
+  default: return 0.0;
+  }
+}
+
+double mxGetNaN(void) { return std::numeric_limits<double>::quiet_NaN(); }
+
+double mxGetInf(void) { return std::numeric_limits<double>::infinity(); }
+
+int mxGetString(const mxArray *array, char *buf, mwSize buflen)
+{
+  if (!mxIsChar(array) || !buflen) return 1;
+  size_t n = get_numel(array);
+  size_t m = n < buflen - 1 ? n : buflen - 1;
+  const mxChar *chars = (const mxChar *)array->data;
+  for (size_t i = 0; i < m; ++i) buf[i] = (char)chars[i];
+  buf[m] = '\0';
+  return m < n;
+}
+
+char *mxArrayToString(const mxArray *array)
+{
+  if (!mxIsChar(array)) return nullptr;
+  size_t n = get_numel(array) + 1;
+  char *str = (char *)mxMalloc(n);
+  mxGetString(array, str, n);
+  return str;
+}
+
+char *mxArrayToUTF8String(const mxArray *array)
+{
+  return mxArrayToString(array);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// struct & cell
+
+int mxGetNumberOfFields(const mxArray *array)
+{
+  return (int)array->fields.size();
+}
+
+const char *mxGetFieldNameByNumber(const mxArray *array, int n)
+{
+  return n < (int)array->fields.size() ? array->fields[n].c_str() : nullptr;
+}
+
+int mxGetFieldNumber(const mxArray *array, const char *name)
+{
+  for (size_t k = 0; k < array->fields.size(); ++k)
+    if (array->fields[k] == name) return (int)k;
+  return -1;
+}
+
+int mxAddField(mxArray *array, const char *name)
+{
+  int k = mxGetFieldNumber(array, name);
+  if (k >= 0) return k;
+
+  size_t nf = array->fields.size(), nel = get_numel(array);
+  std::vector<mxArray *> elems(nel * (nf + 1), nullptr);
+  for (size_t i = 0; i < nel; ++i)
+    for (size_t j = 0; j < nf; ++j)
+      elems[i * (nf + 1) + j] = array->elems[i * nf + j];
+  array->elems = std::move(elems);
+  array->fields.push_back(name);
+  return (int)nf;
+}
+
+void mxRemoveField(mxArray *array, int n)
+{
+  size_t nf = array->fields.size(), nel = get_numel(array);
+  if (n < 0 || n >= (int)nf) return;
+
+  std::vector<mxArray *> elems;
+  elems.reserve(nel * (nf - 1));
+  for (size_t i = 0; i < nel; ++i)
+    for (size_t j = 0; j < nf; ++j)
+    {
+      mxArray *elem = array->elems[i * nf + j];
+      if (j == (size_t)n)
+        mxDestroyArray(elem);
+      else
+        elems.push_back(elem);
+    }
+  array->elems = std::move(elems);
+  array->fields.erase(array->fields.begin() + n);
+}
+
+mxArray *mxGetFieldByNumber(const mxArray *array, mwIndex i, int n)
+{
+  return array->elems[i * array->fields.size() + n];
+}
+
+mxArray *mxGetField(const mxArray *array, mwIndex i, const char *name)
+{
+  int n = mxGetFieldNumber(array, name);
+  return n < 0 ? nullptr : mxGetFieldByNumber(array, i, n);
+}
+
+void mxSetFieldByNumber(mxArray *array, mwIndex i, int n, mxArray *value)
+{
+  mxArray *&elem = array->elems[i * array->fields.size() + n];
+  if (elem != value) mxDestroyArray(elem);
+  elem = adopt(value);
+}
+
+void mxSetField(mxArray *array, mwIndex i, const char *name, mxArray *value)
+{
+  int n = mxGetFieldNumber(array, name);
+  if (n < 0)
+    mexErrMsgIdAndTxt("mxshim:InvalidField", "Unknown field: %s", name);
+  mxSetFieldByNumber(array, i, n, value);
+}
+
+mxArray *mxGetCell(const mxArray *array, mwIndex i) { return array->elems[i]; }
+
+void mxSetCell(mxArray *array, mwIndex i, mxArray *value)
+{
+  mxArray *&elem = array->elems[i];
+  if (elem != value) mxDestroyArray(elem);
+  elem = adopt(value);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// MATLAB objects
+
+mxArray *mxGetProperty(const mxArray *obj, mwIndex, const char *name)
+{
+  auto it = obj->props.find(name);
+  if (it == obj->props.end()) return nullptr;
+  return mxDuplicateArray(it->second); // a copy, as MATLAB does
+}
+
+void mxSetProperty(mxArray *obj, mwIndex, const char *name,
+                   const mxArray *value)
+{
+  mxArray *&prop = obj->props[name];
+  mxDestroyArray(prop);
+  prop = adopt(mxDuplicateArray(value));
+}
+
+mxArray *
+mxShimCreateObject(const char *classname,
+                   std::initializer_list<std::pair<const char *, mxArray *>>
+                       props)
+{
+  mxArray *obj = create(mxOBJECT_CLASS, 1, 1);
+  obj->classname = classname;
+  for (auto &p : props) obj->props[p.first] = adopt(p.second);
+  return obj;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// MEX
+
+int mexPrintf(const char *fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  int n = std::vprintf(fmt, args);
+  va_end(args);
+  return n;
+}
+
+void mexErrMsgTxt(const char *msg) { throw mxShimError("", msg); }
+
+void mexErrMsgIdAndTxt(const char *id, const char *fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  throw_error(id, fmt, args); // va_end skipped as it never returns
+}
+
+void mexWarnMsgTxt(const char *msg)
+{
+  std::fprintf(stderr, "Warning: %s\n", msg);
+}
+
+void mexWarnMsgIdAndTxt(const char *, const char *fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  std::fprintf(stderr, "Warning: ");
+  std::vfprintf(stderr, fmt, args);
+  std::fprintf(stderr, "\n");
+  va_end(args);
+}
+
+int mexCallMATLAB(int nlhs, mxArray *plhs[], int nrhs, mxArray *prhs[],
+                  const char *name)
+{
+  auto it = functions().find(name);
+  if (it == functions().end())
+    mexErrMsgIdAndTxt("mxshim:UndefinedFunction",
+                      "mexCallMATLAB(\"%s\"): function is not registered "
+                      "(see mxShimRegisterFunction).",
+                      name);
+  for (int i = 0; i < nlhs; ++i) plhs[i] = nullptr;
+  it->second(nlhs, plhs, nrhs, prhs);
+  return 0;
+}
+
+void mxShimRegisterFunction(const char *name, mxShimFunction fcn)
+{
+  if (fcn)
+    functions()[name] = std::move(fcn);
+  else
+    functions().erase(name);
+}
+
+void mexLock(void) { ++stats.locks; }
+
+void mexUnlock(void)
+{
+  if (stats.locks) --stats.locks;
+}
+
+void mxShimCall(void (*fcn)(int, mxArray *[], int, const mxArray *[]),
+                int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+  // as in MATLAB, plhs[0] may be set (to ans) even if nlhs is 0
+  const int nout = plhs ? std::max(nlhs, 1) : 0;
+  auto cleanup = [nout, plhs](const bool ok) {
+    in_call = false;
+    for (int i = 0; ok && i < nout; ++i) temps.erase(plhs[i]);
+    auto arrays = std::move(temps);
+    temps.clear();
+    for (auto *array : arrays) mxDestroyArray(array);
+
+    // mx memory not made persistent is freed as MATLAB does
+    auto ptrs = std::move(temp_blocks);
+    temp_blocks.clear();
+    for (auto *ptr : ptrs) mxFree(ptr);
+  };
+
+  for (int i = 0; i < nout; ++i) plhs[i] = nullptr;
+  in_call = true;
+  try
+  {
+    fcn(nlhs, plhs, nrhs, prhs);
+  }
+  catch (...)
+  {
+    cleanup(false);
+    throw;
+  }
+  cleanup(true);
+}
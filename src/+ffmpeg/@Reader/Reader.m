@@ -21,6 +21,7 @@ classdef Reader < matlab.mixin.SetGet & matlab.mixin.CustomDisplay
    %   Methods:
    %     readFrame         - Read the next available frame
    %     hasFrame          - Determine if there is a frame available to read
+   %     getStats          - Per-stage timing & counters (CollectStats)
    %     getFileFormats    - List of known supported video file formats
    %
    %   Properties:
@@ -30,6 +31,47 @@ classdef Reader < matlab.mixin.SetGet & matlab.mixin.CustomDisplay
    %     Duration         - Total length of file in seconds.
    %     CurrentTime      - Location from the start of the file of the current
    %                        frame to be read in seconds.
+   %     DecoderThreads   - Number of threads per decoder (0 to use one per
+   %                        core, default).
+   %     DecoderThreadType - Decoder threading method: 'auto' (default),
+   %                        'frame', or 'slice'.
+   %     DecoderThreadInfo - Threading used by the decoder of each stream
+   %                        (struct array: Stream, ThreadCount, ThreadType).
+   %     Direction        - 'forward' (default) or 'backward'. Reading a single
+   %                        video stream backward (without FilterGraph)
+   %                        decodes each GOP once into a cache and serves
+   %                        its frames in reverse.
+   %     FrameSelection   - Video frames to read: 'all' (default), 'keyframes'
+   %                        (decodes keyframes only), 'nonref-skip' (skips
+   %                        non-reference frames), or 'stride:k' (every k-th
+   %                        frame of the primary stream). READ requires
+   %                        'all'.
+   %     DecodeScale      - Scale of the output video frames: 1 (default),
+   %                        1/2, 1/4, or 1/8. Decoders supporting reduced-
+   %                        resolution (lowres) decoding decode at the
+   %                        reduced size; otherwise, the frames are
+   %                        downscaled as a part of their format conversion.
+   %     ReverseCacheSize - Maximum number of frames cached per GOP (chunk)
+   %                        when reading backward (default 256).
+   %     ConversionBufferSize - Number of video frames converted ahead of the
+   %                        reads by a background thread (0: off, default).
+   %                        Applies only if a single video stream is read.
+   %     StreamBufferSize - Maximum number of buffered frames of each secondary
+   %                        stream (Inf: unbounded, default). A scalar applies
+   %                        to all secondary streams, or specify one value per
+   %                        secondary stream.
+   %     StreamBufferPolicy - Action when a secondary stream buffer is full:
+   %                        'error' (default) raises an error once the
+   %                        stream is left unread for more than
+   %                        StreamBufferSize frames (decoding cannot be
+   %                        paused), 'drop-oldest' discards its oldest frame,
+   %                        and 'spill' moves its oldest frame to a temporary
+   %                        file.
+   %     IndexCache       - Packet index cache used by READ: '' (off, default),
+   %                        'sidecar' (FILENAME.ffidx next to the file), or
+   %                        the path of a cache folder.
+   %     CollectStats     - true to collect the per-stage timing & counters
+   %                        returned by GETSTATS (default false).
    %     Tag              - Generic string for the user to set.
    %     UserData         - Generic field for any user-defined data.
    %
@@ -37,13 +79,41 @@ classdef Reader < matlab.mixin.SetGet & matlab.mixin.CustomDisplay
    %     Height           - Height of the video frame in pixels.
    %     Width            - Width of the video frame in pixels.
    %     VideoFormat      - Video format as it is represented in MATLAB.
+   %                        'planes' returns each frame as a struct of its
+   %                        component planes (e.g., Y, U, and V) at their
+   %                        native resolution, without any conversion.
+   %     VideoDataType    - Class of RGB & grayscale frames: 'uint8' (default),
+   %                        'uint16' (0-65535), or 'single' (0-1). Use
+   %                        'uint16' or 'single' to retain the full bit
+   %                        depth of 10/12-bit video.
    %     FrameRate        - Frame rate of the video in frames per second.
    %
    %   (If contains an audio stream)
-   %     SampleRate       - Audio stream's sampling rate
+   %     SampleRate       - Audio sampling rate. If set, the audio is
+   %                        resampled to it as it is read (default []:
+   %                        the stream's rate).
    %     NumChannels      - Number of channels
-   %     ChannelLayout    - Channel layout
+   %     ChannelLayout    - Channel layout (e.g., 'mono' or 'stereo'). If
+   %                        set, the audio channels are remixed to it as
+   %                        they are read (default '': the stream's).
    %     AudioFormat      - Video format as it is represented in MATLAB.
+   %     AudioLayout      - Layout of the audio outputs: 'frames' (default,
+   %                        Nmax x Nch x Nframes, each frame zero-padded) or
+   %                        'contiguous' (Nsamples x Nch of back-to-back
+   %                        samples).
+   %     WindowLength     - Length of the overlapping audio windows in
+   %                        samples. If nonzero (default 0: off), audio is
+   %                        returned as an Nwin x Nch x K array of the K
+   %                        windows completed by each read, regardless of
+   %                        AudioLayout.
+   %     HopLength        - Number of samples between the starts of the
+   %                        successive windows (default []: WindowLength).
+   %                        Must not exceed WindowLength.
+   %     WindowFunction   - Weights applied to each window: 'rectangular'
+   %                        (default), 'hann', 'hamming', 'blackman', or a
+   %                        vector of WindowLength weights. Requires a
+   %                        floating-point AudioFormat ('flt' or 'dbl')
+   %                        unless rectangular.
    %
    %   Example:
    %       % Construct a multimedia reader object associated with file
@@ -75,6 +145,17 @@ classdef Reader < matlab.mixin.SetGet & matlab.mixin.CustomDisplay
       Duration        % Total length of file in seconds.
       BufferSize = 4  % Underlying frame buffer size
       Direction = 'forward'
+      FrameSelection = 'all' % Video frames to decode: 'all', 'keyframes', 'nonref-skip', or 'stride:k'
+      DecodeScale = 1 % Scale of the output video frames: 1, 1/2, 1/4, or 1/8
+      ReverseCacheSize = 256 % Max. frames per cached GOP chunk for backward reading
+      ConversionBufferSize = 0 % Video frames converted ahead in background (0: off)
+      StreamBufferSize = inf % Frame capacity of secondary streams (scalar or per stream)
+      StreamBufferPolicy = 'error' % Full secondary buffer: 'error', 'drop-oldest', or 'spill'
+      IndexCache = ''  % Packet index cache: '' (off), 'sidecar', or folder
+      CollectStats = false % true to collect per-stage timing & counters (see getStats)
+      DecoderThreads = 0 % Number of decoder threads per stream (0: auto)
+      DecoderThreadType = 'auto' % Decoder threading: 'auto', 'frame', or 'slice'
+      DecoderThreadInfo = [] % Decoder threading in use by each active stream
    end
    
    properties(Access='public', Dependent)
@@ -93,11 +174,16 @@ classdef Reader < matlab.mixin.SetGet & matlab.mixin.CustomDisplay
       Width = []          % Width of the video frame in pixels.
       PixelAspectRatio = []
       VideoFormat = ''     % Video format as it is represented in MATLAB.
+      VideoDataType = 'uint8' % Class of RGB/grayscale frames: 'uint8', 'uint16', or 'single'
       AudioFormat = ''
+      AudioLayout = 'frames' % Audio output layout: 'frames' or 'contiguous'
+      WindowLength = 0     % Audio window length in samples (0: no windowing)
+      HopLength = []       % Audio window hop in samples ([]: WindowLength)
+      WindowFunction = 'rectangular' % Audio window weights (name or vector)
       FilterGraph = ''     % FFmpeg Video filter chain description
-      SampleRate = []
+      SampleRate = []      % Audio sampling rate (set: resample to it)
       NumberOfAudioChannels = []
-      ChannelLayout = ''
+      ChannelLayout = ''   % Audio channel layout (set: remix to it)
       Metadata = []
    end
    
@@ -181,6 +267,7 @@ classdef Reader < matlab.mixin.SetGet & matlab.mixin.CustomDisplay
       varargout = readFrame(obj, varargin)
       varargout = readBuffer(obj)
       eof = hasFrame(obj)
+      stats = getStats(obj)
       
       %------------------------------------------------------------------
       % Overrides of builtins
@@ -304,7 +391,7 @@ classdef Reader < matlab.mixin.SetGet & matlab.mixin.CustomDisplay
       end
       function set.VideoFormat(obj,value)
          try
-            value = validatestring(value,{'rgb24','Grayscale','native'});
+            value = validatestring(value,{'rgb24','Grayscale','native','planes'});
          catch
            value = lower(value);
             validateattributes(value,{'char'},{'row'});
@@ -312,6 +399,9 @@ classdef Reader < matlab.mixin.SetGet & matlab.mixin.CustomDisplay
          end
          obj.VideoFormat = value;
       end
+      function set.VideoDataType(obj,value)
+         obj.VideoDataType = validatestring(value,{'uint8','uint16','single'},mfilename,'VideoDataType');
+      end
       function set.AudioFormat(obj,value)
          try
             value = validatestring(value,{'native'});
@@ -322,6 +412,42 @@ classdef Reader < matlab.mixin.SetGet & matlab.mixin.CustomDisplay
          end
          obj.AudioFormat = value;
       end
+      function set.AudioLayout(obj,value)
+         obj.AudioLayout = validatestring(value,{'frames','contiguous'},mfilename,'AudioLayout');
+      end
+      function set.SampleRate(obj,value)
+         if ~isempty(value)
+            validateattributes(value,{'numeric'},{'scalar','integer','positive'},mfilename,'SampleRate');
+            value = double(value);
+         end
+         obj.SampleRate = value;
+      end
+      function set.ChannelLayout(obj,value)
+         if ~isempty(value)
+            validateattributes(value,{'char'},{'row'},mfilename,'ChannelLayout');
+         end
+         obj.ChannelLayout = value;
+      end
+      function set.WindowLength(obj,value)
+         validateattributes(value,{'numeric'},{'scalar','integer','nonnegative'},mfilename,'WindowLength');
+         obj.WindowLength = double(value);
+      end
+      function set.HopLength(obj,value)
+         if ~isempty(value)
+            validateattributes(value,{'numeric'},{'scalar','integer','positive'},mfilename,'HopLength');
+            value = double(value);
+         end
+         obj.HopLength = value;
+      end
+      function set.WindowFunction(obj,value)
+         if ischar(value)
+            value = validatestring(value,{'rectangular','hann','hamming','blackman'},mfilename,'WindowFunction');
+         else
+            validateattributes(value,{'numeric'},{'vector','real','finite'},mfilename,'WindowFunction');
+            value = double(value(:)).';
+         end
+         obj.WindowFunction = value;
+      end
 
       function set.FilterGraph(obj,value)
          validateattributes(value,{'char'},{'row'});
@@ -332,9 +458,66 @@ classdef Reader < matlab.mixin.SetGet & matlab.mixin.CustomDisplay
          validateattributes(value,{'double'},{'scalar','real','positive','integer'});
          obj.BufferSize = value;
       end
+      function set.StreamBufferSize(obj,value)
+         validateattributes(value,{'double'},{'vector','real','positive','nonnan','nonempty'},mfilename,'StreamBufferSize');
+         if any(value~=floor(value) & ~isinf(value))
+            error('ffmpeg:Reader:InvalidStreamBufferSize','StreamBufferSize must be integer or Inf.');
+         end
+         obj.StreamBufferSize = value;
+      end
+      function set.StreamBufferPolicy(obj,value)
+         obj.StreamBufferPolicy = validatestring(value,{'error','drop-oldest','spill'},mfilename,'StreamBufferPolicy');
+      end
+      function set.FrameSelection(obj,value)
+         validateattributes(value,{'char'},{'row'},mfilename,'FrameSelection');
+         tok = regexp(value,'^stride:(\d+)$','tokens','once');
+         if isempty(tok)
+            value = validatestring(value,{'all','keyframes','nonref-skip'},mfilename,'FrameSelection');
+         elseif str2double(tok{1})<1
+            error('ffmpeg:Reader:InvalidFrameSelection','FrameSelection stride must be a positive integer.');
+         end
+         obj.FrameSelection = value;
+      end
+      function set.DecodeScale(obj,value)
+         validateattributes(value,{'double'},{'scalar','real','positive'},mfilename,'DecodeScale');
+         if ~any(value==[1 1/2 1/4 1/8])
+            error('ffmpeg:Reader:InvalidDecodeScale','DecodeScale must be 1, 1/2, 1/4, or 1/8.');
+         end
+         obj.DecodeScale = value;
+      end
+      function set.ReverseCacheSize(obj,value)
+         validateattributes(value,{'double'},{'scalar','real','positive','integer'},mfilename,'ReverseCacheSize');
+         obj.ReverseCacheSize = value;
+      end
+      function set.ConversionBufferSize(obj,value)
+         validateattributes(value,{'numeric'},{'scalar','real','nonnegative','integer'},mfilename,'ConversionBufferSize');
+         obj.ConversionBufferSize = double(value);
+      end
       function set.Direction(obj,value)
          obj.Direction = validatestring(value,{'forward','backward'},mfilename,'Direction');
       end
+      function set.DecoderThreads(obj,value)
+         validateattributes(value,{'numeric'},{'scalar','real','nonnegative','integer'},mfilename,'DecoderThreads');
+         obj.DecoderThreads = double(value);
+      end
+      function set.DecoderThreadType(obj,value)
+         obj.DecoderThreadType = validatestring(value,{'auto','frame','slice'},mfilename,'DecoderThreadType');
+      end
+      function set.CollectStats(obj,value)
+         validateattributes(value,{'logical','numeric'},{'scalar'},mfilename,'CollectStats');
+         obj.CollectStats = logical(value);
+      end
+      function set.IndexCache(obj,value)
+         validateattributes(value,{'char'},{},mfilename,'IndexCache');
+         if any(strcmpi(value,{'off','none'}))
+            value = '';
+         elseif ~(isempty(value) || strcmp(value,'sidecar'))
+            if ~isfolder(value)
+               error('ffmpeg:Reader:InvalidIndexCache','IndexCache folder does not exist: %s',value);
+            end
+         end
+         obj.IndexCache = value;
+      end
 
       %%%%%%%%%%%%%%%%%%%%%%%%%%
       
@@ -347,6 +530,10 @@ classdef Reader < matlab.mixin.SetGet & matlab.mixin.CustomDisplay
 %          value = ffmpeg.Reader.mex_backend(obj,'getVideoCompression');
 %       end
       
+      function value = get.NumberOfFrames(obj)
+         value = ffmpeg.Reader.mex_backend(obj,'getNumberOfFrames');
+      end
+
       function value = get.CurrentTime(obj)
          value = ffmpeg.Reader.mex_backend(obj,'getCurrentTime');
       end
@@ -370,9 +557,9 @@ classdef Reader < matlab.mixin.SetGet & matlab.mixin.CustomDisplay
          end
          
          propGroups(1) = PropertyGroup( {'Name', 'Path', 'FilterGraph','Streams','Duration', 'CurrentTime'});
-         propGroups(2) = PropertyGroup( {'Width', 'Height', 'PixelAspectRatio','FrameRate', 'VideoFormat'});
-         propGroups(3) = PropertyGroup( {'NumberOfAudioChannels', 'ChannelLayout', 'SampleRate','AudioFormat'});
-         propGroups(4) = PropertyGroup( {'BufferSize','Metadata','Tag', 'UserData'});
+         propGroups(2) = PropertyGroup( {'Width', 'Height', 'PixelAspectRatio','FrameRate', 'VideoFormat', 'VideoDataType'});
+         propGroups(3) = PropertyGroup( {'NumberOfAudioChannels', 'ChannelLayout', 'SampleRate','AudioFormat','AudioLayout','WindowLength','HopLength','WindowFunction'});
+         propGroups(4) = PropertyGroup( {'BufferSize','Direction','FrameSelection','DecodeScale','ReverseCacheSize','ConversionBufferSize','StreamBufferSize','StreamBufferPolicy','DecoderThreads','DecoderThreadType','IndexCache','CollectStats','Metadata','Tag', 'UserData'});
          
          %          propGroups(1) = PropertyGroup( {'Name', 'Path', 'Duration', 'CurrentTime', 'Tag', 'UserData'}, ...
          %             getString( message('ffmpeg:Reader:GeneralProperties') ) );
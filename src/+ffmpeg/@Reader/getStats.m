@@ -0,0 +1,42 @@
+function stats = getStats(obj)
+%GETSTATS Per-stage timing & counters of the reader
+%
+%   STATS = GETSTATS(OBJ) returns the cumulative timing & counters of each
+%   processing stage of each active stream, collected since the reader was
+%   activated. The CollectStats property must be set to true when the
+%   reader is constructed; otherwise, STATS is empty.
+%
+%   STATS is a struct array with an element per stage & stream:
+%
+%      Stage     - 'Read'    : time waited on the reader for the next frame
+%                              (demuxing, decoding, and FilterGraph run on
+%                              the reader's threads and surface here)
+%                  'PostOp'  : format conversion filter of the stream
+%                  'Convert' : conversion into the MATLAB array layout
+%                  'Copy'    : hand-off & copying into the output array
+%                  'Staging' : StreamBufferPolicy staging buffer
+%      Stream    - Stream specifier
+%      WallTime  - Elapsed time spent in the stage in seconds
+%      CPUTime   - CPU time of the thread running the stage in seconds
+%      Frames    - Number of frames processed
+%      Bytes     - Number of bytes processed (input frame data for Read,
+%                  PostOp, & Convert; output data for Copy)
+%      MaxQueued - High-water mark of the frames queued at the stage:
+%                  buffered by the reader (Read), converted ahead
+%                  (Convert, see ConversionBufferSize), or staged (Staging)
+%
+%   Demuxing, decoding, and the FilterGraph are not reported as separate
+%   stages: they run inside the reader's own threads, which expose no
+%   timing hooks, so their cost is only seen as the combined Read wait of
+%   each stream.
+%
+%   Example:
+%      reader = ffmpeg.Reader('xylophone.mp4','CollectStats',true);
+%      while hasFrame(reader)
+%         frame = readFrame(reader);
+%      end
+%      struct2table(getStats(reader))
+%
+%   See also FFMPEG.READER, FFMPEG.READER/READFRAME.
+
+stats = obj.mex_backend(obj,'getStats');
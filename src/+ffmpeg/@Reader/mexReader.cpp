@@ -1,18 +1,24 @@
 #include "mexReader.h"
 
+#include "../../utils/ffmpegAudioUtils.h"
 #include "../../utils/mxutils.h"
-#include <ffmpegImageUtils.h>
+#include "mexReaderBlocks.h"
 
 #include <mexGetString.h>
 
 extern "C"
 {
+#include <libavcodec/avcodec.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/log.h>
+#include <libavutil/mathematics.h>
 #include <libavutil/pixdesc.h>
 #include <libavutil/rational.h>
 #include <libavutil/samplefmt.h>
 }
 
 #include <algorithm>
+#include <cmath>
 #include <numeric>
 
 bool ini = true;
@@ -38,6 +44,10 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 // mexFFmpegReader(mobj, filename) (all arguments  pre-validated)
 mexFFmpegReader::mexFFmpegReader(const mxArray *mxObj, int nrhs,
                                  const mxArray *prhs[])
+    : skip_frame(AVDISCARD_DEFAULT), stride(1), stride_count(0),
+      decode_scale(1), audio_contiguous(false), frame_sample_rate(0),
+      window_offset(AV_NOPTS_VALUE), out_sample_rate(0), out_channel_layout(0),
+      primary_time(-std::numeric_limits<double>::infinity())
 {
   // reserve one temp frame
   add_frame();
@@ -69,6 +79,8 @@ bool mexFFmpegReader::action_handler(const mxArray *mxObj,
   {
     plhs[0] = getCurrentTime();
   }
+  else if (command == "getNumberOfFrames")
+    plhs[0] = getNumberOfFrames();
   else if (command == "get_nb_streams")
     plhs[0] = mxCreateDoubleScalar((double)std::visit(
         [](auto &reader) { return reader.getStreamCount(); }, reader));
@@ -82,6 +94,8 @@ bool mexFFmpegReader::action_handler(const mxArray *mxObj,
     read(nlhs, plhs, nrhs, prhs);
   else if (command == "hasFrame")
     plhs[0] = hasFrame();
+  else if (command == "getStats")
+    plhs[0] = stats.get();
   else if (command == "hasVideo")
     plhs[0] = hasMediaType(AVMEDIA_TYPE_VIDEO);
   else if (command == "hasVideo")
@@ -142,11 +156,18 @@ bool mexFFmpegReader::static_handler(const std::string &command, int nlhs,
 void mexFFmpegReader::setCurrentTime(const mxArray *mxTime)
 {
   mex_duration_t time(mxGetScalar(mxTime));
+  if (pipeline) pipeline->stop();
   std::visit([time](auto &reader) { reader.seek(time); }, reader);
+  clear_stages();
+  reset_windows();
+  stride_count = 0;
+  if (pipeline) pipeline->start();
 }
 
 mxArray *mexFFmpegReader::getCurrentTime()
 {
+  if (pipeline && pipeline->wait())
+    return mxCreateDoubleScalar(pipeline->front().t);
   mex_duration_t t = std::visit(
       [this](auto &reader) {
         return reader.getTimeStamp<mex_duration_t>(streams[0]);
@@ -155,8 +176,16 @@ mxArray *mexFFmpegReader::getCurrentTime()
   return mxCreateDoubleScalar(t.count());
 }
 
+mxArray *mexFFmpegReader::getNumberOfFrames()
+{
+  if (!frame_indexable()) return mxCreateDoubleMatrix(0, 0, mxREAL);
+  int st = index_primary_stream();
+  return mxCreateDoubleScalar((double)index.getNumberOfFrames(st));
+}
+
 bool mexFFmpegReader::has_frame()
 {
+  if (pipeline) return pipeline->wait();
   return !std::visit(
       [this](auto &reader) { return reader.atEndOfStream(streams[0]); },
       reader);
@@ -181,11 +210,11 @@ mxArray *mexFFmpegReader::hasMediaType(const AVMediaType type)
       reader);
 }
 
-//[frame1,frame2,...] = readFrame(obj, varargin);
+//[frame1,frame2,...,ts] = readFrame(obj, varargin);
 void mexFFmpegReader::readFrame(int nlhs, mxArray *plhs[], int nrhs,
                                 const mxArray *prhs[])
 {
-  if (nlhs > streams.size())
+  if (nlhs > streams.size() + 1)
     mexErrMsgIdAndTxt("ffmpeg:Reader:TooManyOutputs",
                       "Too many output arguments.");
 
@@ -193,11 +222,31 @@ void mexFFmpegReader::readFrame(int nlhs, mxArray *plhs[], int nrhs,
     mexErrMsgIdAndTxt("ffmpeg:Reader:EndOfFile",
                       "No more frames available to read from file.");
 
+  // an output past the stream outputs receives the frame timestamps
+  mxArray *mxTS = nullptr;
+  if (nlhs > streams.size())
+  {
+    mxTS = create_timestamps(streams.size());
+    nlhs = (int)streams.size();
+  }
+
   // read the next frame of primary stream
   plhs[0] = read_frames();
+  if (mxTS) set_timestamps(mxTS, 0);
 
-  // for each stream outputs, read the next frame(s) until
-  for (int i = 1; i < nlhs; ++i) plhs[i] = read_frames(streams[i]);
+  // for each stream outputs, read the frame(s) up to the next primary frame
+  if (nlhs > 1)
+  {
+    mex_duration_t t = std::visit(
+        [this](auto &reader) { return sync_time(reader); }, reader);
+    for (int i = 1; i < nlhs; ++i)
+    {
+      plhs[i] = read_frames(streams[i], t);
+      if (mxTS) set_timestamps(mxTS, i);
+    }
+  }
+
+  if (mxTS) plhs[nlhs] = mxTS;
 }
 
 // read frame from the primary stream
@@ -207,25 +256,71 @@ mxArray *mexFFmpegReader::read_frames(const size_t N)
       [this, N](auto &reader) {
         // get primary stream specifier string
         const std::string &spec = streams[0];
+        ffmpeg::IAVFrameSource &src = reader.getStream(spec);
 
         // automatically unreference frame when exiting this function
         purge_frames purger(frames, 0);
 
+        // video frames are rendered directly into the output block as they
+        // arrive, releasing each AVFrame immediately
+        if (src.getMediaType() == AVMEDIA_TYPE_VIDEO)
+        {
+          auto read_block = [&](auto &&block) {
+            frame_pts.clear();
+            if (pipeline) // already converted (and decimated) by the pipeline
+            {
+              mexReaderStats::Counter *copy = stats.find("Copy", spec);
+              if (auto *c = stats.find("Convert", spec))
+                c->queued(pipeline->size());
+              for (size_t i = 0; i < N && pipeline->wait(); ++i)
+              {
+                auto &f = pipeline->front();
+                {
+                  mexReaderStats::Scope timer(copy);
+                  block.append(f.format, f.width, f.height, f.data.data());
+                }
+                frame_pts.push_back(f.pts);
+                pipeline->pop();
+              }
+              return release_block(block, spec);
+            }
+
+            mexReaderStats::Counter *convert = stats.find("Convert", spec);
+            AVFrame *frame = frames[0];
+            for (size_t i = 0; i < N && !read_next_frame(reader, frame, spec);)
+            {
+              // 'stride:k' drops the frames in between before any conversion
+              if (stride_count++ % stride == 0)
+              {
+                mexReaderStats::Scope timer(convert);
+                block.append(frame);
+                timer.count(1, mexReaderStats::frame_bytes(frame));
+                frame_pts.push_back(get_pts(frame));
+                ++i;
+              }
+              av_frame_unref(frame);
+              stage_frames(); // keep the bounded secondary streams bounded
+            }
+            return release_block(block, spec);
+          };
+          if (planes_output(spec)) return read_block(mexPlanesBlock(N));
+          return read_block(mexVideoBlock(N, native_format(spec)));
+        }
+
         // read frames with ts less than the next primary stream frame
         bool eof = false;
         for (int i = 0; i < N && !eof; ++i)
         {
           if (frames.size() <= purger.nfrms) add_frame();
           AVFrame *frame = frames[purger.nfrms];
-          eof = reader.readNextFrame(frame, spec);
+          eof = read_next_frame(reader, frame, spec);
           if (!eof) ++purger.nfrms;
+          stage_frames(); // keep the bounded secondary streams bounded
         }
 
-        ffmpeg::IAVFrameSource &src = reader.getStream(spec);
-        if (src.getMediaType() == AVMEDIA_TYPE_VIDEO)
-          return read_video_frame(purger.nfrms);
-        else if (src.getMediaType() == AVMEDIA_TYPE_AUDIO)
-          return read_audio_frame(purger.nfrms);
+        collect_pts(purger.nfrms);
+        if (src.getMediaType() == AVMEDIA_TYPE_AUDIO)
+          return read_audio_frame(spec, purger.nfrms);
         else
           throw ffmpeg::Exception(
               "Encountered data from an unexpected stream.");
@@ -234,43 +329,23 @@ mxArray *mexFFmpegReader::read_frames(const size_t N)
 }
 
 // returns mxArray containing the specified secondary stream data
-mxArray *mexFFmpegReader::read_frames(const std::string &spec)
+mxArray *mexFFmpegReader::read_frames(const std::string &spec,
+                                      const mex_duration_t t)
 {
   return std::visit(
-      [this, spec](auto &reader) {
-        // first, get the time stamp of the next primary stream frame
-        auto ts = reader.getTimeStamp<mex_duration_t>(streams[0]);
-
+      [this, &spec, t](auto &reader) {
         // automatically unreference frame when exiting this function
         purge_frames purger(frames, 0);
 
         // read frames with ts less than the next primary stream frame
-        bool eof = false;
-        while (!eof)
-        {
-          // secondary frame may not be available
-          mex_duration_t t;
-          try
-          {
-            t = reader.getTimeStamp<mex_duration_t>(spec);
-          }
-          catch (ffmpeg::Exception &) // no frame avail.
-          {
-            return mxCreateDoubleMatrix(0, 0, mxREAL);
-          }
-          if (t >= ts) break;
-
-          if (frames.size() <= purger.nfrms) add_frame();
-          AVFrame *frame = frames[purger.nfrms];
-          eof = reader.readNextFrame(frame, spec);
-          if (!eof) ++purger.nfrms;
-        }
+        pull_frames(reader, spec, t, purger);
 
+        collect_pts(purger.nfrms);
         ffmpeg::IAVFrameSource &src = reader.getStream(spec);
         if (src.getMediaType() == AVMEDIA_TYPE_VIDEO)
-          return read_video_frame(purger.nfrms);
+          return read_video_frame(spec, purger.nfrms);
         else if (src.getMediaType() == AVMEDIA_TYPE_AUDIO)
-          return read_audio_frame(purger.nfrms);
+          return read_audio_frame(spec, purger.nfrms);
         else
           throw ffmpeg::Exception(
               "Encountered data from an unexpected stream.");
@@ -278,11 +353,11 @@ mxArray *mexFFmpegReader::read_frames(const std::string &spec)
       reader);
 }
 
-//[frame1,frame2,...] = readBuffer(obj, varargin);
+//[frame1,frame2,...,ts] = readBuffer(obj, varargin);
 void mexFFmpegReader::readBuffer(int nlhs, mxArray *plhs[], int nrhs,
                                  const mxArray *prhs[])
 {
-  if (nlhs > streams.size())
+  if (nlhs > streams.size() + 1)
     mexErrMsgIdAndTxt("ffmpeg:Reader:TooManyOutputs",
                       "Too many output arguments.");
 
@@ -290,14 +365,87 @@ void mexFFmpegReader::readBuffer(int nlhs, mxArray *plhs[], int nrhs,
     mexErrMsgIdAndTxt("ffmpeg:Reader:EndOfFile",
                       "No more frames available to read from file.");
 
+  // an output past the stream outputs receives the frame timestamps
+  mxArray *mxTS = nullptr;
+  if (nlhs > streams.size())
+  {
+    mxTS = create_timestamps(streams.size());
+    nlhs = (int)streams.size();
+  }
+
   // must get the secondary buffer first (automatically discarded when primary
   // buffer is empty)
-  for (int i = 1; i < nlhs; ++i) plhs[i] = read_buffer(streams[i]);
+  for (int i = 1; i < nlhs; ++i)
+  {
+    plhs[i] = read_buffer(streams[i]);
+    if (mxTS) set_timestamps(mxTS, i);
+  }
 
   // read the next frame of primary stream
-  plhs[0] = read_frames(std::visit(
-      [this](auto &reader) { return reader.getNumBufferedFrames(streams[0]); },
-      reader));
+  plhs[0] = read_frames(
+      pipeline ? pipeline->size()
+               : std::visit(
+                     [this](auto &reader) {
+                       return reader.getNumBufferedFrames(streams[0]);
+                     },
+                     reader));
+  if (mxTS)
+  {
+    set_timestamps(mxTS, 0);
+    plhs[nlhs] = mxTS;
+  }
+}
+
+mxArray *mexFFmpegReader::create_timestamps(const size_t n)
+{
+  const char *fields[] = {"Stream", "Time", "Pts", "SampleOffset"};
+  mxArray *mxTS = mxCreateStructMatrix(1, n, 4, fields);
+  for (size_t i = 0; i < n; ++i)
+    mxSetField(mxTS, i, "Stream", mxCreateString(streams[i].c_str()));
+  return mxTS;
+}
+
+void mexFFmpegReader::set_timestamps(mxArray *mxTS, const int i)
+{
+  // raw ticks in the stream time base (after filtering, if any)
+  AVRational tb = std::visit(
+      [this, i](auto &reader) {
+        return reader.getStream(streams[i]).getTimeBase();
+      },
+      reader);
+
+  size_t n = frame_pts.size();
+  mxArray *mxTime = mxCreateUninitNumericMatrix(n, 1, mxDOUBLE_CLASS, mxREAL);
+  mxArray *mxPts = mxCreateUninitNumericMatrix(n, 1, mxINT64_CLASS, mxREAL);
+  double *t = mxGetPr(mxTime);
+  int64_t *pts = (int64_t *)mxGetData(mxPts);
+  for (size_t k = 0; k < n; ++k)
+  {
+    pts[k] = frame_pts[k];
+    t[k] = frame_pts[k] == AV_NOPTS_VALUE ? mxGetNaN()
+                                          : frame_pts[k] * av_q2d(tb);
+  }
+  mxSetField(mxTS, i, "Time", mxTime);
+  mxSetField(mxTS, i, "Pts", mxPts);
+
+  // audio: 0-based index of the first output sample in the stream
+  if (window_offset != AV_NOPTS_VALUE)
+    mxSetField(mxTS, i, "SampleOffset",
+               mxCreateDoubleScalar((double)window_offset));
+  else if (frame_sample_rate && n && frame_pts[0] != AV_NOPTS_VALUE)
+    mxSetField(mxTS, i, "SampleOffset",
+               mxCreateDoubleScalar((double)av_rescale_q(
+                   frame_pts[0], tb, {1, frame_sample_rate})));
+  else
+    mxSetField(mxTS, i, "SampleOffset", mxCreateDoubleMatrix(0, 0, mxREAL));
+}
+
+void mexFFmpegReader::collect_pts(const size_t nframes)
+{
+  frame_pts.clear();
+  for (size_t i = 0; i < nframes; ++i) frame_pts.push_back(get_pts(frames[i]));
+  frame_sample_rate = nframes ? frames[0]->sample_rate : 0;
+  window_offset = AV_NOPTS_VALUE;
 }
 
 // returns mxArray containing the specified secondary stream data
@@ -308,21 +456,34 @@ mxArray *mexFFmpegReader::read_buffer(const std::string &spec)
         // automatically unreference frame when exiting this function
         purge_frames purger(frames, 0);
 
+        // staged stream: take all the frames from its staging buffer
+        if (auto it = stages.find(spec); it != stages.end())
+        {
+          stage_frames();
+          auto &stage = it->second;
+          while (stage.size())
+          {
+            if (frames.size() <= purger.nfrms) add_frame();
+            stage.pop(frames[purger.nfrms++]);
+          }
+        }
+
         // read frames with ts less than the next primary stream frame
         bool eof = false;
         while (reader.getNumBufferedFrames(spec) && !eof)
         {
           if (frames.size() <= purger.nfrms) add_frame();
           AVFrame *frame = frames[purger.nfrms];
-          eof = reader.readNextFrame(frame, spec);
+          eof = read_next_frame(reader, frame, spec);
           if (!eof) ++purger.nfrms;
         }
 
+        collect_pts(purger.nfrms);
         ffmpeg::IAVFrameSource &src = reader.getStream(spec);
         if (src.getMediaType() == AVMEDIA_TYPE_VIDEO)
-          return read_video_frame(purger.nfrms);
+          return read_video_frame(spec, purger.nfrms);
         else if (src.getMediaType() == AVMEDIA_TYPE_AUDIO)
-          return read_audio_frame(purger.nfrms);
+          return read_audio_frame(spec, purger.nfrms);
         else
           throw ffmpeg::Exception(
               "Encountered data from an unexpected stream.");
@@ -331,131 +492,222 @@ mxArray *mexFFmpegReader::read_buffer(const std::string &spec)
 }
 
 // convert data in the first nframes AVFrames in the frames vector
-mxArray *mexFFmpegReader::read_video_frame(size_t nframes)
+mxArray *mexFFmpegReader::read_video_frame(const std::string &spec,
+                                           size_t nframes)
 {
   // could be empty
-  if (!nframes) return mxCreateNumericMatrix(0, 0, mxUINT8_CLASS, mxREAL);
-
-  AVFrame *frame = frames[0];
-
-  // ffmpeg::IVideoHandler &vsrc = dynamic_cast<ffmpeg::IVideoHandler &>(src);
-  int width = frame->width;
-  int height = frame->height;
-  AVPixelFormat format = (AVPixelFormat)frame->format;
-
-  int frame_data_sz =
-      ffmpeg::imageGetComponentBufferSize(format, width, height);
-
-  mwSize dims[4] = {(mwSize)width, (mwSize)height,
-                    (mwSize)frame_data_sz / (width * height), nframes};
-  mxArray *mxData = mxCreateNumericArray(4, dims, mxUINT8_CLASS, mxREAL);
-  uint8_t *data = (uint8_t *)mxGetData(mxData);
-
-  for (size_t i = 0; i < nframes; ++i)
-  {
-    frame = frames[i];
-    ffmpeg::imageCopyToComponentBuffer(data, frame_data_sz, frame->data,
-                                       frame->linesize, format, frame->width,
-                                       frame->height);
-    data += frame_data_sz;
-  }
-  return mxData;
+  auto render = [this, &spec, nframes](auto &&block) {
+    {
+      mexReaderStats::Scope timer(stats.find("Convert", spec));
+      for (size_t i = 0; i < nframes; ++i)
+      {
+        block.append(frames[i]);
+        timer.count(1, mexReaderStats::frame_bytes(frames[i]));
+      }
+    }
+    return release_block(block, spec);
+  };
+  if (planes_output(spec)) return render(mexPlanesBlock(nframes));
+  return render(mexVideoBlock(nframes, native_format(spec)));
 }
 
 // convert data in the first nframes AVFrames in the frames vector
-mxArray *mexFFmpegReader::read_audio_frame(size_t nframes)
+mxArray *mexFFmpegReader::read_audio_frame(const std::string &spec,
+                                           size_t nframes)
 {
   // ffmpeg::IAudioHandler &asrc = dynamic_cast<ffmpeg::IAudioHandler &>(src);
 
+  // windowed output (may flush the last windows even if no frame is read)
+  if (auto it = windowers.find(spec); it != windowers.end())
+    return read_audio_windows(spec, nframes, it->second);
+
   // could be empty
   if (!nframes) return mxCreateDoubleMatrix(0, 0, mxREAL);
 
+  // samples are copied straight into the mxArray
+  mexReaderStats::Scope timer(stats.find("Copy", spec));
+
   AVFrame *frame = frames[0];
 
   AVSampleFormat fmt = (AVSampleFormat)frame->format;
 
-  // just in case...
-  if (!(bool)av_sample_fmt_is_planar(fmt))
-    throw ffmpeg::Exception(
-        "FFmpeg reader must output audio streams in planar format.");
+  // samples are written straight to the columns, planar or packed
+  mxClassID mx_class = get_audio_class(fmt);
 
-  mxClassID mx_class;
-  switch (fmt)
+  if (audio_contiguous)
   {
-  case AV_SAMPLE_FMT_U8P: ///< unsigned 8 bits
-    mx_class = mxUINT8_CLASS;
-    break;
-  case AV_SAMPLE_FMT_S16P: ///< signed 16 bits
-    mx_class = mxINT16_CLASS;
-    break;
-  case AV_SAMPLE_FMT_S32P: ///< signed 32 bits
-    mx_class = mxINT32_CLASS;
-    break;
-  case AV_SAMPLE_FMT_FLTP: ///< float
-    mx_class = mxSINGLE_CLASS;
-    break;
-  case AV_SAMPLE_FMT_DBLP: ///< double
-    mx_class = mxDOUBLE_CLASS;
-    break;
-  case AV_SAMPLE_FMT_S64P: ///< signed 64 bits
-    mx_class = mxINT64_CLASS;
-    break;
-  default: throw ffmpeg::Exception("Unknown audio sample format.");
+    // total_nb_samples x channels: the frames are written back to back into
+    // the channel columns in a single pass
+    size_t total_nb_samples = std::reduce(
+        frames.begin(), frames.begin() + nframes, (size_t)0,
+        [](size_t N, AVFrame *frame) { return N + frame->nb_samples; });
+    mxArray *mxData = mxCreateUninitNumericMatrix(
+        total_nb_samples, frame->channels, mx_class, mxREAL);
+    uint8_t *dst = (uint8_t *)mxGetData(mxData);
+    size_t elsz = mxGetElementSize(mxData);
+    timer.count(nframes, total_nb_samples * frame->channels * elsz);
+
+    for (size_t j = 0; j < nframes; ++j)
+    {
+      frame = frames[j];
+      ffmpeg::audioCopyToColumns(dst, total_nb_samples, frame->data, 0,
+                                 frame->nb_samples, frame->channels, fmt);
+      dst += frame->nb_samples * elsz;
+    }
+    return mxData;
   }
 
   int max_nb_samples = std::reduce(
       frames.begin(), frames.begin() + nframes, 0,
       [](int N, AVFrame *frame) { return std::max(N, frame->nb_samples); });
 
+  // max_nb_samples x channels x nframes, each frame channel in its own column
+  // (every element is written below, so skip the zero-fill)
   mwSize dims[3] = {(mwSize)max_nb_samples, (mwSize)frame->channels, nframes};
-  mxArray *mxData = mxCreateNumericArray(3, dims, mx_class, mxREAL);
-  uint8_t *data = (uint8_t *)mxGetData(mxData);
-
-  auto elsz = mxGetElementSize(mxData);
-
-  uint8_t *dst[AV_NUM_DATA_POINTERS];
-  for (int i = 0; i < frame->channels; ++i) dst[i] = data + i * max_nb_samples;
-  dst[frame->channels] = nullptr;
+  mxArray *mxData = mxCreateUninitNumericArray(3, dims, mx_class, mxREAL);
+  uint8_t *dst = (uint8_t *)mxGetData(mxData);
 
-  // output data size in bytes
-  int nbuf = frame->channels *
-             av_samples_get_buffer_size(nullptr, frame->channels,
-                                        frame->nb_samples, fmt, false);
+  size_t elsz = mxGetElementSize(mxData);
+  size_t col_size = max_nb_samples * elsz; // bytes per channel column
+  timer.count(nframes, nframes * frame->channels * col_size);
 
   for (int j = 0; j < nframes; ++j)
   {
     frame = frames[j];
 
     // copy the data
-    av_samples_copy(dst, frame->data, 0, 0, frame->nb_samples, frame->channels,
-                    fmt);
+    ffmpeg::audioCopyToColumns(dst, max_nb_samples, frame->data, 0,
+                               frame->nb_samples, frame->channels, fmt);
 
     // if frame contains less # of samples, fill the remainder with zeros
     if (frame->nb_samples < max_nb_samples)
     {
-      size_t nrem = max_nb_samples - frame->nb_samples;
+      size_t nrem = (max_nb_samples - frame->nb_samples) * elsz;
       for (int i = 0; i < frame->channels; ++i)
-        std::fill_n(dst[i] + frame->nb_samples, nrem, 0);
+        std::fill_n(dst + i * col_size + frame->nb_samples * elsz, nrem, 0);
     }
 
-    // increment the
-    for (int i = 0; i < frame->channels; ++i) dst[i] += nbuf;
+    // next frame
+    dst += frame->channels * col_size;
+  }
+
+  return mxData;
+}
+
+mxArray *mexFFmpegReader::read_audio_windows(const std::string &spec,
+                                             size_t nframes,
+                                             mexAudioWindower &win)
+{
+  mexReaderStats::Scope timer(stats.find("Copy", spec));
+
+  // the last (zero-padded) window is due once the stream is exhausted
+  AVRational tb;
+  bool eos = std::visit(
+      [this, &spec, &tb](auto &reader) {
+        tb = reader.getStream(spec).getTimeBase();
+        return reader.atEndOfStream(spec);
+      },
+      reader);
+  if (auto it = stages.find(spec); it != stages.end() && it->second.size())
+    eos = false;
+
+  for (size_t j = 0; j < nframes; ++j)
+  {
+    AVFrame *frame = frames[j];
+    int64_t pts = get_pts(frame);
+    win.push(frame, pts == AV_NOPTS_VALUE
+                        ? 0
+                        : av_rescale_q(pts, tb, {1, frame->sample_rate}));
   }
 
-  // call MATLAB transpose function to finalize combined-audio output
-  mxArray *mxDataT;
-  mexCallMATLAB(1, &mxDataT, 1, &mxData, "transpose");
-  mxDestroyArray(mxData);
+  // nothing decoded yet: sample format unknown
+  if (!win.channels()) return mxCreateDoubleMatrix(0, 0, mxREAL);
+
+  size_t K = eos ? win.size_at_eof() : win.size();
+  mwSize dims[3] = {(mwSize)win.window_length(), (mwSize)win.channels(),
+                    (mwSize)K};
+  mxArray *mxData = mxCreateUninitNumericArray(
+      3, dims, get_audio_class(win.format()), mxREAL);
+  timer.count(nframes,
+              mxGetNumberOfElements(mxData) * mxGetElementSize(mxData));
+
+  window_offset = win.sample_offset();
+  win.pop((uint8_t *)mxGetData(mxData), K);
+  return mxData;
+}
 
-  return mxDataT;
+mxClassID mexFFmpegReader::get_audio_class(const AVSampleFormat fmt)
+{
+  switch (av_get_planar_sample_fmt(fmt))
+  {
+  case AV_SAMPLE_FMT_U8P: ///< unsigned 8 bits
+    return mxUINT8_CLASS;
+  case AV_SAMPLE_FMT_S16P: ///< signed 16 bits
+    return mxINT16_CLASS;
+  case AV_SAMPLE_FMT_S32P: ///< signed 32 bits
+    return mxINT32_CLASS;
+  case AV_SAMPLE_FMT_FLTP: ///< float
+    return mxSINGLE_CLASS;
+  case AV_SAMPLE_FMT_DBLP: ///< double
+    return mxDOUBLE_CLASS;
+  case AV_SAMPLE_FMT_S64P: ///< signed 64 bits
+    return mxINT64_CLASS;
+  default: throw ffmpeg::Exception("Unknown audio sample format.");
+  }
 }
 
-void mexFFmpegReader::read(
-    int nlhs, mxArray *plhs[], int nrhs,
-    const mxArray *prhs[]) // varargout = read(obj, varargin);
+// video = read(obj), read(obj,index), read(obj,[first last])
+void mexFFmpegReader::read(int nlhs, mxArray *plhs[], int nrhs,
+                           const mxArray *prhs[])
 {
-  throw std::runtime_error(
-      "Not supported. Use readFrame() or readBuffer() instead.");
+  if (nlhs > 2)
+    mexErrMsgIdAndTxt("ffmpeg:Reader:TooManyOutputs",
+                      "Too many output arguments.");
+
+  if (!frame_indexable())
+    mexErrMsgIdAndTxt("ffmpeg:Reader:read:NotSupported",
+                      "read() requires the primary stream to be a video "
+                      "stream, read forward without a filter graph. Use "
+                      "readFrame() or readBuffer() instead.");
+
+  int st = index_primary_stream();
+  double nfrms = (double)index.getNumberOfFrames(st);
+
+  // 1-based frame range (default: all frames, Inf: last frame)
+  double range[2] = {1.0, INFINITY};
+  if (nrhs > 0 && !mxIsChar(prhs[0])) // ignore trailing 'native'
+  {
+    size_t n = mxGetNumberOfElements(prhs[0]);
+    if (!mxIsDouble(prhs[0]) || mxIsComplex(prhs[0]) || n < 1 || n > 2)
+      mexErrMsgIdAndTxt("ffmpeg:Reader:read:InvalidIndex",
+                        "INDEX must be a real scalar or a 2-element vector.");
+    double *idx = mxGetPr(prhs[0]);
+    range[0] = range[1] = idx[0];
+    if (n > 1) range[1] = idx[1];
+  }
+  for (auto &i : range)
+    if (std::isinf(i) && i > 0) i = nfrms;
+
+  if (range[0] < 1 || range[0] != std::floor(range[0]) ||
+      range[1] != std::floor(range[1]) || range[1] < range[0])
+    mexErrMsgIdAndTxt("ffmpeg:Reader:read:InvalidIndex",
+                      "INDEX must contain positive integers in ascending "
+                      "order.");
+  if (range[1] > nfrms)
+    mexErrMsgIdAndTxt("ffmpeg:Reader:read:IndexOutOfRange",
+                      "Requested frame %.0f is beyond the last frame (%.0f).",
+                      range[1], nfrms);
+
+  size_t first = (size_t)range[0] - 1;
+  if (pipeline) pipeline->stop();
+  seek_frame(st, first);
+  if (pipeline) pipeline->start();
+  plhs[0] = read_frames((size_t)range[1] - first);
+  if (nlhs > 1)
+  {
+    plhs[1] = create_timestamps(1);
+    set_timestamps(plhs[1], 0);
+  }
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////
@@ -463,12 +715,42 @@ void mexFFmpegReader::read(
 // finalize the configuration and activate the reader
 void mexFFmpegReader::activate(mxArray *mxObj)
 {
+  // load the packet index from its cache file if enabled & up-to-date
+  std::string cache = mexGetString(mxGetProperty(mxObj, 0, "IndexCache"));
+  if (cache.size())
+  {
+    std::string url = std::get<0>(reader).getFilePath();
+    index_cache = ffmpeg::PacketIndex::getCachePath(
+        url, cache == "sidecar" ? "" : cache);
+    index.load(index_cache, url);
+  }
+
+  get_frame_selection(mxObj);
+
   // if set to reverse direction, swap out the reader
   backward = mexGetString(mxGetProperty(mxObj, 0, "Direction")) == "backward";
   if (backward)
   {
     std::string url = std::get<0>(reader).getFilePath();
-    reader.emplace<ffmpegRevReader>(url);
+
+    // a single unfiltered video stream is read by the GOP-cached engine
+    // (which needs all the frames): resolve the streams with the forward
+    // reader to find out
+    bool gop = false;
+    if (all_frames_selected() &&
+        mexGetString(mxGetProperty(mxObj, 0, "FilterGraph")).empty())
+    {
+      set_streams(mxObj);
+      gop = streams.size() == 1 &&
+            std::get<0>(reader).getStream(streams[0]).getMediaType() ==
+                AVMEDIA_TYPE_VIDEO;
+      streams.clear();
+    }
+
+    if (gop)
+      reader.emplace<mexGopReverseReader>(url);
+    else
+      reader.emplace<ffmpegRevReader>(url);
   }
 
   std::visit(
@@ -480,6 +762,17 @@ void mexFFmpegReader::activate(mxArray *mxObj)
         // set streams to read based on Streams property value
         set_streams(mxObj);
 
+        // set decoder threading before the decoders are opened
+        set_decoder_threads(mxObj);
+        set_frame_selection();
+        set_decode_scale(mxObj);
+
+        // set up staging of the bounded secondary streams
+        set_stream_buffers(mxObj);
+
+        // create the stage counters before the post-ops take them
+        set_stats(mxObj);
+
         // activate the reader (fills all buffers with at least one frame)
         reader.activate();
 
@@ -493,6 +786,8 @@ void mexFFmpegReader::activate(mxArray *mxObj)
           mxSetCell(mxData, i, mxCreateString(streams[i].c_str()));
         mxSetProperty(mxObj, 0, "Streams", mxData);
 
+        mxSetProperty(mxObj, 0, "DecoderThreadInfo", get_decoder_threads());
+
         mxSetProperty(
             mxObj, 0, "Duration",
             mxCreateDoubleScalar(reader.getDuration<mex_duration_t>().count()));
@@ -509,8 +804,21 @@ void mexFFmpegReader::activate(mxArray *mxObj)
           auto p = dynamic_cast<const ffmpeg::VideoParams &>(
               reader.getStream(*spec).getMediaParams());
 
-          mxSetProperty(mxObj, 0, "Height", mxCreateDoubleScalar(p.height));
-          mxSetProperty(mxObj, 0, "Width", mxCreateDoubleScalar(p.width));
+          // report the output size: scaled from the coded size of the
+          // stream (the decoder may already report its lowres size)
+          int width = p.width, height = p.height;
+          auto *ist =
+              dynamic_cast<ffmpeg::InputStream *>(&reader.getStream(*spec));
+          if (ist)
+          {
+            width = ist->getAVStream()->codecpar->width;
+            height = ist->getAVStream()->codecpar->height;
+          }
+          width = (width + decode_scale - 1) / decode_scale;
+          height = (height + decode_scale - 1) / decode_scale;
+
+          mxSetProperty(mxObj, 0, "Height", mxCreateDoubleScalar(height));
+          mxSetProperty(mxObj, 0, "Width", mxCreateDoubleScalar(width));
           mxSetProperty(mxObj, 0, "FrameRate",
                         mxCreateDoubleScalar(av_q2d(p.frame_rate)));
           mxSetProperty(mxObj, 0, "PixelAspectRatio",
@@ -529,18 +837,186 @@ void mexFFmpegReader::activate(mxArray *mxObj)
           ffmpeg::IAudioHandler &ahdl =
               dynamic_cast<ffmpeg::IAudioHandler &>(reader.getStream(*spec));
 
+          // report the output audio if resampled or remixed by the post-op
+          int nch = ahdl.getChannels();
+          std::string layout = ahdl.getChannelLayoutName();
+          if (out_channel_layout)
+          {
+            char buf[64];
+            nch = av_get_channel_layout_nb_channels(out_channel_layout);
+            av_get_channel_layout_string(buf, sizeof(buf), nch,
+                                         out_channel_layout);
+            layout = buf;
+          }
           mxSetProperty(mxObj, 0, "NumberOfAudioChannels",
-                        mxCreateDoubleScalar(ahdl.getChannels()));
+                        mxCreateDoubleScalar(nch));
           mxSetProperty(mxObj, 0, "SampleRate",
-                        mxCreateDoubleScalar(ahdl.getSampleRate()));
+                        mxCreateDoubleScalar(out_sample_rate
+                                                 ? out_sample_rate
+                                                 : ahdl.getSampleRate()));
           mxSetProperty(mxObj, 0, "ChannelLayout",
-                        mxCreateString(ahdl.getChannelLayoutName().c_str()));
+                        mxCreateString(layout.c_str()));
         }
 
         // populate metadata
         mxSetProperty(mxObj, 0, "Metadata", mxCreateTags(reader.getMetadata()));
       },
       reader);
+
+  // start the GOP-cached reverse engine (needs the packet index)
+  if (auto *rdr = std::get_if<mexGopReverseReader>(&reader))
+  {
+    if (index.empty()) build_index(rdr->getFilePath());
+    size_t ncache =
+        (size_t)mxGetScalar(mxGetProperty(mxObj, 0, "ReverseCacheSize"));
+    rdr->start(index, rdr->getStreamId(streams[0]), streams[0], ncache);
+  }
+
+  set_pipeline(mxObj);
+}
+
+void mexFFmpegReader::set_stats(const mxArray *mxObj)
+{
+  stats.enable(mxIsLogicalScalarTrue(mxGetProperty(mxObj, 0, "CollectStats")));
+  if (!stats.is_enabled()) return;
+
+  for (auto &spec : streams)
+  {
+    for (auto stage : {"Read", "PostOp", "Convert", "Copy"})
+      stats.add(stage, spec);
+    if (stages.count(spec)) stats.add("Staging", spec);
+  }
+}
+
+void mexFFmpegReader::set_pipeline(const mxArray *mxObj)
+{
+  size_t N =
+      (size_t)mxGetScalar(mxGetProperty(mxObj, 0, "ConversionBufferSize"));
+  if (!N) return;
+
+  const std::string spec = streams[0];
+  bool video = std::visit(
+      [&spec](auto &reader) {
+        return reader.getStream(spec).getMediaType() == AVMEDIA_TYPE_VIDEO;
+      },
+      reader);
+  if (streams.size() != 1 || !video)
+  {
+    ffmpeg::Exception::log(AV_LOG_WARNING,
+                           "ConversionBufferSize is ignored as it requires a "
+                           "single video stream.\n");
+    return;
+  }
+
+  // worker-side read: applies 'stride:k' before the frame is converted
+  auto source = [this, spec](AVFrame *frame, double &t) {
+    return std::visit(
+        [this, &spec, frame, &t](auto &reader) {
+          while (!reader.atEndOfStream(spec))
+          {
+            t = reader.getTimeStamp<mex_duration_t>(spec).count();
+            if (read_next_frame(reader, frame, spec)) break;
+            if (stride_count++ % stride == 0) return false;
+            av_frame_unref(frame);
+          }
+          return true;
+        },
+        reader);
+  };
+
+  // worker-side conversion: renders the frame as its output block would
+  mexConvertPipeline::Renderer renderer;
+  mexReaderStats::Counter *convert = stats.find("Convert", spec);
+  if (planes_output(spec))
+    renderer = [convert](std::vector<uint8_t> &dst, const AVFrame *frame) {
+      mexReaderStats::Scope timer(convert);
+      dst.resize(mexPlanesBlock::get_frame_size(
+          (AVPixelFormat)frame->format, frame->width, frame->height));
+      mexPlanesBlock::render(dst.data(), frame);
+      timer.count(1, mexReaderStats::frame_bytes(frame));
+    };
+  else
+    renderer = [convert, dst_fmt = native_format(spec)](
+                   std::vector<uint8_t> &dst, const AVFrame *frame) {
+      mexReaderStats::Scope timer(convert);
+      size_t size = mexVideoBlock::get_frame_size(
+          (AVPixelFormat)frame->format, frame->width, frame->height, dst_fmt);
+      dst.resize(size);
+      mexVideoBlock::render(dst.data(), size, frame, dst_fmt);
+      timer.count(1, mexReaderStats::frame_bytes(frame));
+    };
+
+  pipeline = std::make_unique<mexConvertPipeline>(N, source, renderer);
+  pipeline->start();
+}
+
+bool mexFFmpegReader::frame_indexable()
+{
+  return !backward && filt_desc.empty() && all_frames_selected() &&
+         std::get<ffmpegReader>(reader).getStream(streams[0]).getMediaType() ==
+             AVMEDIA_TYPE_VIDEO;
+}
+
+int mexFFmpegReader::index_primary_stream()
+{
+  ffmpegReader &rdr = std::get<ffmpegReader>(reader);
+  if (index.empty()) build_index(rdr.getFilePath());
+  return rdr.getStreamId(streams[0]);
+}
+
+void mexFFmpegReader::build_index(const std::string &url)
+{
+  index.build(url);
+
+  // failing to cache only costs the next session another demux pass
+  if (index_cache.size())
+  {
+    try
+    {
+      index.save(index_cache, url);
+    }
+    catch (std::exception &e)
+    {
+      ffmpeg::Exception::log(AV_LOG_WARNING,
+                             "Failed to save the index cache: %s\n",
+                             e.what());
+    }
+  }
+}
+
+void mexFFmpegReader::seek_frame(const int st, const size_t n)
+{
+  ffmpegReader &rdr = std::get<ffmpegReader>(reader);
+  const std::string &spec = streams[0];
+
+  // keyframe to start decoding from
+  size_t key = index.getKeyFrame(st, n);
+
+  // no need to seek if frame n is reachable from the current position
+  bool seek = true;
+  mex_duration_t tnext;
+  if (peek_time(rdr, spec, tnext))
+  {
+    size_t next = index.findFrame(st, tnext.count());
+    seek = next < key || next > n;
+  }
+  if (seek)
+  {
+    rdr.seek(mex_duration_t(index.getFrameTime(st, key)), false);
+    clear_stages();
+    reset_windows();
+  }
+
+  // frame n is the first frame past the midpoint from its predecessor
+  if (!n) return;
+  mex_duration_t t(
+      (index.getFrameTime(st, n - 1) + index.getFrameTime(st, n)) / 2.0);
+  AVFrame *frame = frames[0];
+  while (peek_time(rdr, spec, tnext) && tnext < t)
+  {
+    read_next_frame(rdr, frame, spec);
+    av_frame_unref(frame);
+  }
 }
 
 void mexFFmpegReader::set_streams(const mxArray *mxObj)
@@ -675,12 +1151,214 @@ void mexFFmpegReader::set_streams(const mxArray *mxObj)
       reader);
 }
 
+size_t mexFFmpegReader::get_stream_buffer_size(const mxArray *mxObj,
+                                               const size_t k)
+{
+  // scalar applies to all the secondary streams, else one per stream
+  mxArray *mxSize = mxGetProperty(mxObj, 0, "StreamBufferSize");
+  size_t n = mxGetNumberOfElements(mxSize);
+  double N = mxGetPr(mxSize)[k < n ? k : n - 1];
+  return std::isinf(N) ? 0 : (size_t)N;
+}
+
+mexFrameStage::Policy
+mexFFmpegReader::get_stream_buffer_policy(const mxArray *mxObj)
+{
+  std::string policy =
+      mexGetString(mxGetProperty(mxObj, 0, "StreamBufferPolicy"));
+  if (policy == "drop-oldest") return mexFrameStage::Policy::DropOldest;
+  if (policy == "spill") return mexFrameStage::Policy::Spill;
+  return mexFrameStage::Policy::Error;
+}
+
+void mexFFmpegReader::set_stream_buffers(const mxArray *mxObj)
+{
+  auto policy = get_stream_buffer_policy(mxObj);
+  for (size_t k = 1; k < streams.size(); ++k)
+    if (size_t N = get_stream_buffer_size(mxObj, k - 1))
+      stages.emplace(streams[k], mexFrameStage(N, policy));
+}
+
+void mexFFmpegReader::stage_frames()
+{
+  std::visit(
+      [this](auto &reader) {
+        for (auto &stage : stages)
+        {
+          const std::string &spec = stage.first;
+          while (reader.getNumBufferedFrames(spec))
+          {
+            double t = reader.getTimeStamp<mex_duration_t>(spec).count();
+            AVFrame *frame = av_frame_alloc();
+            if (!frame)
+              mexErrMsgIdAndTxt("ffmpeg:Reader:NoMemory",
+                                "Failed to allocate memory for an AVFrame.");
+            if (read_next_frame(reader, frame, spec))
+            {
+              av_frame_free(&frame);
+              break;
+            }
+            stage.second.push(frame, t);
+          }
+
+          // an 'error' stream cannot pause the reader (the primary frame would
+          // never come if the stream is not read), so fail instead once its
+          // frames preceding the last primary frame (i.e., left unread) pile
+          // up past the capacity
+          if (stage.second.lagging(primary_time))
+            mexErrMsgIdAndTxt(
+                "ffmpeg:Reader:StreamBufferFull",
+                "Secondary stream %s fell more than StreamBufferSize frames "
+                "behind the primary stream. Read it along with the primary "
+                "stream, increase StreamBufferSize, or use the 'drop-oldest' "
+                "or 'spill' StreamBufferPolicy.",
+                spec.c_str());
+          if (auto *c = stats.find("Staging", spec))
+            c->queued(stage.second.size());
+        }
+      },
+      reader);
+}
+
+void mexFFmpegReader::get_frame_selection(const mxArray *mxObj)
+{
+  std::string sel = mexGetString(mxGetProperty(mxObj, 0, "FrameSelection"));
+  skip_frame = AVDISCARD_DEFAULT;
+  stride = 1;
+  if (sel == "keyframes")
+    skip_frame = AVDISCARD_NONKEY;
+  else if (sel == "nonref-skip")
+    skip_frame = AVDISCARD_NONREF;
+  else if (sel.compare(0, 7, "stride:") == 0) // pre-validated
+    stride = std::stoul(sel.substr(7));
+}
+
+void mexFFmpegReader::set_frame_selection()
+{
+  if (skip_frame == AVDISCARD_DEFAULT) return;
+  std::visit(
+      [this](auto &reader) {
+        for (auto &spec : streams)
+        {
+          auto *st =
+              dynamic_cast<ffmpeg::InputStream *>(&reader.getStream(spec));
+          if (!st || st->getMediaType() != AVMEDIA_TYPE_VIDEO) continue;
+
+          // the decoder skips the frames, and demuxers honoring the stream
+          // discard level drop their packets before they reach the decoder
+          st->getCodecContext()->skip_frame = skip_frame;
+          st->getAVStream()->discard = skip_frame;
+        }
+      },
+      reader);
+}
+
+void mexFFmpegReader::set_decode_scale(const mxArray *mxObj)
+{
+  // DecodeScale is pre-validated to be 1, 1/2, 1/4, or 1/8
+  decode_scale =
+      (int)std::round(1.0 / mxGetScalar(mxGetProperty(mxObj, 0, "DecodeScale")));
+  post_scales.clear();
+  if (decode_scale == 1) return;
+
+  int lowres = 0;
+  while ((1 << lowres) < decode_scale) ++lowres;
+
+  std::visit(
+      [this, lowres](auto &reader) {
+        for (auto &spec : streams)
+        {
+          // filter graph outputs are downscaled by their post-ops
+          auto *st =
+              dynamic_cast<ffmpeg::InputStream *>(&reader.getStream(spec));
+          if (!st || st->getMediaType() != AVMEDIA_TYPE_VIDEO) continue;
+
+          // decode at 1/2^lowres of the coded size as far as the decoder
+          // supports (e.g., MJPEG & some legacy MPEG decoders), and leave the
+          // rest to the post-op
+          AVCodecContext *ctx = st->getCodecContext();
+          const AVCodec *codec = avcodec_find_decoder(ctx->codec_id);
+          int n = codec ? std::min(lowres, (int)codec->max_lowres) : 0;
+          ctx->lowres = n;
+          post_scales[spec] = decode_scale >> n;
+        }
+      },
+      reader);
+}
+
+void mexFFmpegReader::set_decoder_threads(const mxArray *mxObj)
+{
+  int count = (int)mxGetScalar(mxGetProperty(mxObj, 0, "DecoderThreads"));
+  std::string type =
+      mexGetString(mxGetProperty(mxObj, 0, "DecoderThreadType"));
+  int flags = type == "frame"   ? FF_THREAD_FRAME
+              : type == "slice" ? FF_THREAD_SLICE
+                                : FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+  std::visit(
+      [this, count, flags](auto &reader) {
+        for (auto &spec : streams)
+        {
+          // filter graph outputs are not decoded directly
+          auto *st =
+              dynamic_cast<ffmpeg::InputStream *>(&reader.getStream(spec));
+          if (!st) continue;
+          AVCodecContext *ctx = st->getCodecContext();
+          ctx->thread_count = count; // 0: one per core
+          ctx->thread_type = flags;
+        }
+      },
+      reader);
+}
+
+mxArray *mexFFmpegReader::get_decoder_threads()
+{
+  const char *fields[] = {"Stream", "ThreadCount", "ThreadType"};
+  mxArray *mxInfo = mxCreateStructMatrix(1, streams.size(), 3, fields);
+  std::visit(
+      [this, mxInfo](auto &reader) {
+        for (int i = 0; i < streams.size(); ++i)
+        {
+          mxSetField(mxInfo, i, "Stream", mxCreateString(streams[i].c_str()));
+          auto *st =
+              dynamic_cast<ffmpeg::InputStream *>(&reader.getStream(streams[i]));
+          if (!st) continue; // filter graph output: left empty
+
+          // active_thread_type is what the opened decoder actually uses
+          const AVCodecContext *ctx = st->getCodecContext();
+          const char *type = "none";
+          if (ctx->active_thread_type & FF_THREAD_FRAME)
+            type = "frame";
+          else if (ctx->active_thread_type & FF_THREAD_SLICE)
+            type = "slice";
+          mxSetField(mxInfo, i, "ThreadCount",
+                     mxCreateDoubleScalar(ctx->thread_count));
+          mxSetField(mxInfo, i, "ThreadType", mxCreateString(type));
+        }
+      },
+      reader);
+  return mxInfo;
+}
+
+AVPixelFormat mexFFmpegReader::get_planes_format(const AVPixelFormat fmt)
+{
+  // convert to full-resolution planes of the same kind & bit depth class
+  const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+  bool wide = desc->comp[0].depth > 8;
+  if (desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL))
+    return wide ? AV_PIX_FMT_GBRP16LE : AV_PIX_FMT_GBRP;
+  if (desc->nb_components < 3)
+    return wide ? AV_PIX_FMT_GRAY16LE : AV_PIX_FMT_GRAY8;
+  return wide ? AV_PIX_FMT_YUV444P16LE : AV_PIX_FMT_YUV444P;
+}
+
 void mexFFmpegReader::set_postops(mxArray *mxObj)
 {
   std::visit(
       [this, mxObj](auto &reader) {
         AVPixelFormat pixfmt = AV_PIX_FMT_NB;
         AVSampleFormat samplefmt = AV_SAMPLE_FMT_NB;
+        bool planes = false; // output component planes at native resolution
 
         // video format: AV_PIX_FMT_NB->pick RGB/Grayscale|
         // AV_PIX_FMT_NONE->native
@@ -690,12 +1368,18 @@ void mexFFmpegReader::set_postops(mxArray *mxObj)
           std::string pixdesc = mexGetString(mxFormat);
           if (pixdesc == "native")
             pixfmt = AV_PIX_FMT_NONE;
+          else if (pixdesc == "planes")
+            planes = true;
           else if (pixdesc == "Grayscale")
             pixfmt = AV_PIX_FMT_GRAY8;
           else
             pixfmt = av_get_pix_fmt(pixdesc.c_str());
         }
 
+        // RGB & grayscale outputs may be uint16 or single (VideoDataType)
+        std::string datatype =
+            mexGetString(mxGetProperty(mxObj, 0, "VideoDataType"));
+
         // audio format: AV_SAMPLE_FMT_NB->native
         mxFormat = mxGetProperty(mxObj, 0, "AudioFormat");
         if (!mxIsEmpty(mxFormat))
@@ -705,17 +1389,88 @@ void mexFFmpegReader::set_postops(mxArray *mxObj)
             samplefmt = av_get_sample_fmt((sampledesc + "p").c_str());
         }
 
+        // audio sample rate & channel layout: converted by the post-op if
+        // set (empty: native)
+        mxArray *mxRate = mxGetProperty(mxObj, 0, "SampleRate");
+        if (!mxIsEmpty(mxRate)) out_sample_rate = (int)mxGetScalar(mxRate);
+        std::string layoutdesc;
+        mxArray *mxLayout = mxGetProperty(mxObj, 0, "ChannelLayout");
+        if (!mxIsEmpty(mxLayout))
+        {
+          out_channel_layout =
+              av_get_channel_layout(mexGetString(mxLayout).c_str());
+          if (!out_channel_layout)
+            mexErrMsgIdAndTxt("ffmpeg:Reader:InvalidChannelLayout",
+                              "%s is not a valid FFmpeg channel layout.",
+                              mexGetString(mxLayout).c_str());
+          char buf[64];
+          av_get_channel_layout_string(
+              buf, sizeof(buf),
+              av_get_channel_layout_nb_channels(out_channel_layout),
+              out_channel_layout);
+          layoutdesc = buf;
+        }
+
+        // audio layout: 'frames' (padded frame stack) or 'contiguous'
+        audio_contiguous =
+            mexGetString(mxGetProperty(mxObj, 0, "AudioLayout")) ==
+            "contiguous";
+
+        // audio windows: WindowLength samples every HopLength samples
+        size_t nwin =
+            (size_t)mxGetScalar(mxGetProperty(mxObj, 0, "WindowLength"));
+        size_t hop = nwin;
+        std::vector<double> window;
+        if (nwin)
+        {
+          mxArray *mxHop = mxGetProperty(mxObj, 0, "HopLength");
+          if (!mxIsEmpty(mxHop)) hop = (size_t)mxGetScalar(mxHop);
+          if (hop > nwin)
+            mexErrMsgIdAndTxt("ffmpeg:Reader:InvalidHopLength",
+                              "HopLength must not exceed WindowLength.");
+
+          mxArray *mxWindow = mxGetProperty(mxObj, 0, "WindowFunction");
+          if (mxIsChar(mxWindow))
+            window =
+                mexAudioWindower::get_window(mexGetString(mxWindow), nwin);
+          else
+          {
+            if (mxGetNumberOfElements(mxWindow) != nwin)
+              mexErrMsgIdAndTxt(
+                  "ffmpeg:Reader:InvalidWindowFunction",
+                  "WindowFunction vector must have WindowLength elements.");
+            double *w = mxGetPr(mxWindow);
+            window.assign(w, w + nwin);
+          }
+        }
+
         for (auto &spec : streams)
         {
           auto &st = reader.getStream(spec);
           auto type = st.getMediaType();
           if (type == AVMEDIA_TYPE_VIDEO)
           {
+            auto nativefmt =
+                dynamic_cast<ffmpeg::IVideoHandler &>(st).getFormat();
+
+            if (planes)
+            {
+              // planes are transposed natively from the decoded frames, via
+              // an untransposed post-op only if downscaled or its format is
+              // not supported
+              AVPixelFormat fmt = ffmpeg::imageTransposePlanesSupported(nativefmt)
+                                      ? nativefmt
+                                      : get_planes_format(nativefmt);
+              int scale = post_scale(spec);
+              if (scale > 1 || fmt != nativefmt)
+                set_video_postop(reader, spec, fmt, scale, false);
+              planes_outs.insert(spec);
+              continue;
+            }
+
             // set post-filter to transpose & change video format
             if (pixfmt == AV_PIX_FMT_NONE || pixfmt == AV_PIX_FMT_NB)
             {
-              auto nativefmt =
-                  dynamic_cast<ffmpeg::IVideoHandler &>(st).getFormat();
               if (pixfmt == AV_PIX_FMT_NB) // default
               {
                 if (av_pix_fmt_desc_get(nativefmt)->nb_components == 1)
@@ -731,13 +1486,49 @@ void mexFFmpegReader::set_postops(mxArray *mxObj)
               {
                 mxSetProperty(mxObj, 0, "VideoFormat",
                               mxCreateString(av_get_pix_fmt_name(nativefmt)));
-                reader.setPostOp<mexFFmpegVideoPostOp, const AVPixelFormat>(
-                    spec, nativefmt);
+                set_video_postop(reader, spec, nativefmt, post_scale(spec));
               }
             }
             if (pixfmt != AV_PIX_FMT_NONE)
-              reader.setPostOp<mexFFmpegVideoPostOp, const AVPixelFormat>(
-                  spec, pixfmt);
+            {
+              // convert & transpose in one pass if supported, else fall back
+              // to the post-op filter graph (which also downscales the frames
+              // if lowres decoding did not fully achieve DecodeScale)
+              int scale = post_scale(spec);
+              bool gray = pixfmt == AV_PIX_FMT_GRAY8;
+              if (datatype != "uint8" && (gray || pixfmt == AV_PIX_FMT_RGB24))
+              {
+                // uint16 & single are always rendered natively to keep the
+                // full bit depth; the post-op (if needed) only converts to an
+                // untransposed 16-bit intermediate
+                AVPixelFormat outfmt =
+                    datatype == "uint16"
+                        ? (gray ? AV_PIX_FMT_GRAY16 : AV_PIX_FMT_RGB48)
+                        : (gray ? AV_PIX_FMT_GRAYF32 : AV_PIX_FMT_GBRPF32);
+                native_fmts[spec] = outfmt;
+                if (scale > 1 ||
+                    !ffmpeg::imageTransposeSupported(nativefmt, outfmt))
+                  set_video_postop(reader, spec,
+                                   gray ? AV_PIX_FMT_GRAY16LE
+                                        : AV_PIX_FMT_GBRP16LE,
+                                   scale, false);
+              }
+              else if (scale == 1 &&
+                       ffmpeg::imageTransposeSupported(nativefmt, pixfmt))
+                native_fmts[spec] = pixfmt;
+              else if (gray || pixfmt == AV_PIX_FMT_RGB24)
+              {
+                // swscale writes planar gbrp (or gray) directly, whose planes
+                // are transposed natively into the R, G, & B (or Y) planes of
+                // the output block (no transpose filter or copy pass)
+                set_video_postop(reader, spec,
+                                 gray ? AV_PIX_FMT_GRAY8 : AV_PIX_FMT_GBRP,
+                                 scale, false);
+                native_fmts[spec] = pixfmt;
+              }
+              else
+                set_video_postop(reader, spec, pixfmt, scale);
+            }
           }
           else if (type == AVMEDIA_TYPE_AUDIO)
           {
@@ -750,15 +1541,36 @@ void mexFFmpegReader::set_postops(mxArray *mxObj)
                                 av_get_packed_sample_fmt(nativefmt))));
               samplefmt = nativefmt;
             }
-            // pick planer/packed data format depending on whether to combine
-            // frames
-            samplefmt = av_get_planar_sample_fmt(samplefmt);
-
-            // if requested format is different from the stream format, set
-            // postop
-            if (samplefmt != nativefmt)
-              reader.setPostOp<mexFFmpegAudioPostOp, const AVSampleFormat>(
-                  spec, samplefmt);
+            // if requested sample type, rate, or channel layout is different
+            // from the stream's, set postop (planar & packed frames are both
+            // written straight to the output columns, so the layout alone
+            // needs no conversion)
+            auto &ahdl = dynamic_cast<ffmpeg::IAudioHandler &>(st);
+            int rate = out_sample_rate != ahdl.getSampleRate()
+                           ? out_sample_rate
+                           : 0;
+            std::string layout =
+                out_channel_layout &&
+                        out_channel_layout != ahdl.getChannelLayout()
+                    ? layoutdesc
+                    : "";
+            if (rate || layout.size() ||
+                av_get_planar_sample_fmt(samplefmt) !=
+                    av_get_planar_sample_fmt(nativefmt))
+              reader.setPostOp<mexFFmpegAudioPostOp, const AVSampleFormat,
+                               const int, const std::string, const AVRational,
+                               mexReaderStats::Counter *>(
+                  spec, av_get_planar_sample_fmt(samplefmt), rate, layout,
+                  st.getTimeBase(), stats.find("PostOp", spec));
+
+            if (nwin)
+            {
+              if (window.size() && !mexAudioWindower::weightable(samplefmt))
+                mexErrMsgIdAndTxt("ffmpeg:Reader:InvalidWindowFunction",
+                                  "WindowFunction requires a floating-point "
+                                  "AudioFormat ('flt' or 'dbl').");
+              windowers.emplace(spec, mexAudioWindower(nwin, hop, window));
+            }
           }
         }
       },
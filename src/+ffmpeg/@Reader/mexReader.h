@@ -3,14 +3,23 @@
 #include <mexAllocator.h>
 #include <mexObjectHandler.h>
 
+#include "../../utils/ffmpegPacketIndex.h"
+#include "mexReaderGopReverse.h"
+#include "mexReaderPipeline.h"
 #include "mexReaderPostOps.h"
+#include "mexReaderStaging.h"
+#include "mexReaderStats.h"
+#include "mexReaderWindows.h"
 #include <ffmpegAVFrameDoubleBuffer.h>
 #include <ffmpegReaderMT.h>
 #include <ffmpegReaderRev.h>
 
 #include <chrono>
+#include <limits>
+#include <memory>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <variant>
 #include <vector>
 
@@ -46,9 +55,12 @@ class mexFFmpegReader
     return std::visit(
         [mxObj, spec](auto &reader) {
           // the first stream gets the finite buffer size while the secondary
-          // streams are dynamically buffered
+          // streams are dynamically buffered so the reader never stalls on
+          // them (their bounds are enforced by staging, see
+          // set_stream_buffers())
           if (reader.getActiveStreamCount() > 0)
-          { return reader.addStream(spec); } else
+            return reader.addStream(spec);
+          else
           {
             int N = (int)mxGetScalar(mxGetProperty(mxObj, 0, "BufferSize"));
             auto ret = reader.addStream(spec, -1, N);
@@ -69,6 +81,7 @@ class mexFFmpegReader
             const mxArray *prhs[]); // varargout = read(obj, varargin);
   void setCurrentTime(const mxArray *mxTime);
   mxArray *getCurrentTime();
+  mxArray *getNumberOfFrames();
 
   static mxArray *
   mxCreateFileFormatName(AVPixelFormat fmt); // formats = getFileFormats();
@@ -76,14 +89,78 @@ class mexFFmpegReader
   static mxArray *getFileFormats();  // formats = getFileFormats();
   static mxArray *getVideoFormats(); // formats = getVideoFormats();
 
-  std::variant<ffmpegReader, ffmpegRevReader> reader;
+  // per-stage counters (CollectStats), declared before reader as its post-ops
+  // & pipeline hold pointers to the counters
+  mexReaderStats stats;
+
+  /**
+   * \brief Create the counters of the active streams if CollectStats is set
+   *        (must be called before the post-ops are set)
+   */
+  void set_stats(const mxArray *mxObj);
+
+  std::variant<ffmpegReader, ffmpegRevReader, mexGopReverseReader> reader;
   bool backward; // true to read frames backward from the end of the file
 
+  // background conversion of the primary video stream (ConversionBufferSize),
+  // declared after reader so that it stops before reader is destroyed
+  std::unique_ptr<mexConvertPipeline> pipeline;
+
+  /**
+   * \brief Start the background conversion pipeline if ConversionBufferSize
+   *        is set and the only active stream is a video stream
+   */
+  void set_pipeline(const mxArray *mxObj);
+
   std::string filt_desc; // actual filter graph description
 
   std::vector<std::string> streams; /// names of active video streams
   std::unordered_map<std::string, mexFFmpegVideoPostOp>
       postfilts; // post-process video filters
+  std::unordered_map<std::string, AVPixelFormat>
+      native_fmts; // output formats of natively converted video streams
+  std::unordered_set<std::string>
+      planes_outs; // video streams output as component planes
+  bool audio_contiguous; // true to output audio as one Nsamples x Nch block
+                         // (AudioLayout 'contiguous')
+  std::unordered_map<std::string, mexAudioWindower>
+      windowers; // audio streams output as overlapping windows (WindowLength)
+  int out_sample_rate;         // resampled audio rate (0: native)
+  uint64_t out_channel_layout; // remixed audio channel layout (0: native)
+
+  ffmpeg::PacketIndex index; // packet index, built on the first frame-indexed
+                             // access
+  std::string index_cache;   // path of the index cache file ("" to not cache)
+
+  /**
+   * \brief Returns true if the primary stream supports frame-indexed access
+   *        (forward-read unfiltered video stream)
+   */
+  bool frame_indexable();
+
+  /**
+   * \brief Build the packet index (and save it to the index cache file if
+   *        enabled)
+   */
+  void build_index(const std::string &url);
+
+  /**
+   * \brief Build the packet index if not built yet (and save it to the index
+   *        cache file if enabled)
+   *
+   * \returns the file stream id of the primary stream
+   */
+  int index_primary_stream();
+
+  /**
+   * \brief Position the primary stream so that its next frame is the n-th
+   *        (0-based) frame
+   *
+   * Seeks to the keyframe preceding the frame only if the frame cannot be
+   * reached by decoding forward from the current position, then discards
+   * the frames before it.
+   */
+  void seek_frame(const int st, const size_t n);
 
   /**
    * \brief Setup filter graph & streams according to the Matlab class object
@@ -91,12 +168,142 @@ class mexFFmpegReader
    */
   void set_streams(const mxArray *mxObj);
 
+  /**
+   * \brief Returns the buffer capacity of the k-th secondary stream per the
+   *        StreamBufferSize property (0 if unbounded)
+   */
+  static size_t get_stream_buffer_size(const mxArray *mxObj, const size_t k);
+
+  /**
+   * \brief Returns the StreamBufferPolicy property value
+   */
+  static mexFrameStage::Policy get_stream_buffer_policy(const mxArray *mxObj);
+
+  std::unordered_map<std::string, mexFrameStage>
+      stages; // staging buffers of bounded secondary streams
+  double primary_time; // time of the last primary frame read (-inf: none)
+
+  /**
+   * \brief Set up the staging buffers of the bounded secondary streams
+   */
+  void set_stream_buffers(const mxArray *mxObj);
+
+  /**
+   * \brief Move all the frames of the staged secondary streams from the
+   *        reader to their staging buffers
+   *
+   * Raises ffmpeg:Reader:StreamBufferFull if an 'error' policy stream falls
+   * more than its StreamBufferSize behind the primary stream.
+   */
+  void stage_frames();
+
+  /**
+   * \brief Discard all the staged frames (after seek)
+   */
+  void clear_stages()
+  {
+    for (auto &stage : stages) stage.second.clear();
+    primary_time = -std::numeric_limits<double>::infinity();
+  }
+
+  /**
+   * \brief Discard the samples buffered for the audio windows (after seek)
+   */
+  void reset_windows()
+  {
+    for (auto &win : windowers) win.second.reset();
+  }
+
+  // FrameSelection property: frames discarded by the video decoders & the
+  // primary stream decimation
+  AVDiscard skip_frame; // AVDISCARD_DEFAULT, NONKEY ('keyframes') or NONREF
+  size_t stride;        // 'stride:k': output every k-th frame
+  size_t stride_count;  // primary frames read since the last seek
+
+  /**
+   * \brief Parse the FrameSelection property
+   */
+  void get_frame_selection(const mxArray *mxObj);
+
+  /**
+   * \brief Returns true if every frame of the video streams is output
+   */
+  bool all_frames_selected() const
+  {
+    return skip_frame == AVDISCARD_DEFAULT && stride == 1;
+  }
+
+  /**
+   * \brief Set the frame discarding of the video decoders & demuxer streams
+   *        per FrameSelection (must be called before reader.activate())
+   */
+  void set_frame_selection();
+
+  // DecodeScale property: output frames are 1/decode_scale of the coded size
+  int decode_scale; // 1, 2, 4, or 8
+  std::unordered_map<std::string, int>
+      post_scales; // residual downscale of each video stream after lowres
+
+  /**
+   * \brief Set the lowres decoding of the video decoders per DecodeScale, and
+   *        the remaining downscale to be done by the post-ops (must be called
+   *        before reader.activate())
+   */
+  void set_decode_scale(const mxArray *mxObj);
+
+  /**
+   * \brief Returns the downscale factor left to the post-op of the stream
+   */
+  int post_scale(const std::string &spec) const
+  {
+    auto it = post_scales.find(spec);
+    return it == post_scales.end() ? decode_scale : it->second;
+  }
+
+  /**
+   * \brief Configure the decoder threading of the active streams according to
+   *        the DecoderThreads & DecoderThreadType properties (must be called
+   *        before the decoders are opened by reader.activate())
+   */
+  void set_decoder_threads(const mxArray *mxObj);
+
+  /**
+   * \brief Returns a struct array of the threading used by the decoder of
+   *        each active stream (fields: Stream, ThreadCount, ThreadType)
+   */
+  mxArray *get_decoder_threads();
+
   /**
    * \brief Add post-filters to the active streams to make them ready to be
    * exported to MATLAB
    */
   void set_postops(mxArray *mxObj);
 
+  /**
+   * \brief Returns the output format if the video stream is converted
+   *        natively (AV_PIX_FMT_NONE if converted by its post-op)
+   */
+  AVPixelFormat native_format(const std::string &spec) const
+  {
+    auto it = native_fmts.find(spec);
+    return it == native_fmts.end() ? AV_PIX_FMT_NONE : it->second;
+  }
+
+  /**
+   * \brief Returns true if the video stream is output as component planes
+   *        (VideoFormat 'planes')
+   */
+  bool planes_output(const std::string &spec) const
+  {
+    return planes_outs.count(spec);
+  }
+
+  /**
+   * \brief Returns the planar format to convert the frames to if their pixel
+   *        format cannot be output as component planes as is
+   */
+  static AVPixelFormat get_planes_format(const AVPixelFormat fmt);
+
   /**
    * \brief Returns true if not eof
    */
@@ -110,12 +317,15 @@ class mexFFmpegReader
   mxArray *read_frames(const size_t N = 1);
 
   /**
-   * \brief Read the next frame(s) of the specified secondary stream
+   * \brief Read the frames of the specified secondary stream presented before
+   *        the given time
    *
    * \param[in]  spec   Name of the stream to retrieve (must not be the primary
-   * spec, unchecked) \returns mxArray containing the received frame(s).
+   *                    spec, unchecked)
+   * \param[in]  t      Sync time (see sync_time())
+   * \returns mxArray containing the received frame(s).
    */
-  mxArray *read_frames(const std::string &spec);
+  mxArray *read_frames(const std::string &spec, const mex_duration_t t);
 
   /**
    * \brief Read the next frame(s) of the specified secondary stream
@@ -125,8 +335,122 @@ class mexFFmpegReader
    */
   mxArray *read_buffer(const std::string &spec);
 
-  mxArray *read_video_frame(size_t nframes);
-  mxArray *read_audio_frame(size_t nframes);
+  mxArray *read_video_frame(const std::string &spec, size_t nframes);
+  mxArray *read_audio_frame(const std::string &spec, size_t nframes);
+
+  /**
+   * \brief Append the first nframes AVFrames to the stream's windower and
+   *        output its complete windows as a Nwin x Nch x K array (plus the
+   *        zero-padded last window at the end of the stream)
+   */
+  mxArray *read_audio_windows(const std::string &spec, size_t nframes,
+                              mexAudioWindower &win);
+
+  /**
+   * \brief MATLAB class of the samples of a planar or packed sample format
+   */
+  static mxClassID get_audio_class(const AVSampleFormat fmt);
+
+  /**
+   * \brief Read the next frame of a stream from the reader, timed & counted
+   *        as its Read stage
+   */
+  template <typename Reader>
+  bool read_next_frame(Reader &reader, AVFrame *frame, const std::string &spec)
+  {
+    mexReaderStats::Counter *c = stats.find("Read", spec);
+    mexReaderStats::Scope timer(c);
+    if (c) c->queued(reader.getNumBufferedFrames(spec));
+    if (spec == streams[0])
+    {
+      mex_duration_t t;
+      if (peek_time(reader, spec, t)) primary_time = t.count();
+    }
+    bool eof = reader.readNextFrame(frame, spec);
+    if (!eof) timer.count(1, mexReaderStats::frame_bytes(frame));
+    return eof;
+  }
+
+  /**
+   * \brief Peek the time of the next frame of a stream without throwing
+   *
+   * \returns false (t unchanged) if the stream has no more frame
+   */
+  template <typename Reader>
+  static bool peek_time(Reader &reader, const std::string &spec,
+                        mex_duration_t &t)
+  {
+    if (reader.atEndOfStream(spec)) return false;
+    t = reader.template getTimeStamp<mex_duration_t>(spec);
+    return true;
+  }
+
+  /**
+   * \brief Time up to which the secondary streams are pulled: the time of the
+   *        next primary frame, or +inf once the primary stream runs out so
+   *        that the secondary streams are drained
+   */
+  template <typename Reader> mex_duration_t sync_time(Reader &reader)
+  {
+    mex_duration_t t(std::numeric_limits<double>::infinity());
+    peek_time(reader, streams[0], t);
+    return t;
+  }
+
+  /**
+   * \brief Hand a video block over to its mxArray, timed & counted as the
+   *        Copy stage of the stream
+   */
+  template <typename Block>
+  mxArray *release_block(Block &block, const std::string &spec)
+  {
+    mexReaderStats::Scope timer(stats.find("Copy", spec));
+    timer.count(block.size(), block.bytes());
+    return block.release();
+  }
+
+  /**
+   * \brief Set the video post-op of a stream (timed as its PostOp stage)
+   */
+  template <typename Reader>
+  void set_video_postop(Reader &reader, const std::string &spec,
+                        const AVPixelFormat fmt, const int scale,
+                        const bool transpose = true)
+  {
+    reader.template setPostOp<mexFFmpegVideoPostOp, const AVPixelFormat,
+                              const int, const bool,
+                              mexReaderStats::Counter *>(
+        spec, fmt, scale, transpose, stats.find("PostOp", spec));
+  }
+
+  // pts of the frames output by the last read_frames() or read_buffer()
+  std::vector<int64_t> frame_pts;
+  int frame_sample_rate; // sample rate of the output audio frames (0: video)
+  int64_t window_offset; // first sample of the output audio windows
+                         // (AV_NOPTS_VALUE if not windowed)
+
+  static int64_t get_pts(const AVFrame *frame)
+  {
+    return frame->best_effort_timestamp != AV_NOPTS_VALUE
+               ? frame->best_effort_timestamp
+               : frame->pts;
+  }
+
+  /**
+   * \brief Record the pts of the first nframes AVFrames in the frames vector
+   */
+  void collect_pts(const size_t nframes);
+
+  /**
+   * \brief Create the timestamp output: struct array with a element per
+   *        stream (fields: Stream, Time, Pts, SampleOffset)
+   */
+  mxArray *create_timestamps(const size_t n);
+
+  /**
+   * \brief Fill the i-th element of the timestamp output with frame_pts
+   */
+  void set_timestamps(mxArray *mxTS, const int i);
 
   // temp frame storage & management
   std::vector<AVFrame *> frames;
@@ -148,6 +472,17 @@ public:
 private:
     std::vector<AVFrame *> &frames;
   };
+
+  /**
+   * \brief Pull the frames of a secondary stream presented before time t
+   *        into frames[purger.nfrms...]
+   *
+   * Stops at the first frame at or past t or when the stream runs out of
+   * frames.
+   */
+  template <typename Reader>
+  void pull_frames(Reader &reader, const std::string &spec,
+                   const mex_duration_t t, purge_frames &purger);
 };
 
 // inlines & template member function implementations
@@ -159,3 +494,30 @@ inline void mexFFmpegReader::add_frame()
                       "Failed to allocate memory for an AVFrame.");
   frames.push_back(frame);
 }
+
+template <typename Reader>
+void mexFFmpegReader::pull_frames(Reader &reader, const std::string &spec,
+                                  const mex_duration_t t,
+                                  purge_frames &purger)
+{
+  // staged stream: serve the frames from its staging buffer
+  if (auto it = stages.find(spec); it != stages.end())
+  {
+    stage_frames();
+    auto &stage = it->second;
+    while (stage.size() && stage.front_time() < t.count())
+    {
+      if (frames.size() <= purger.nfrms) add_frame();
+      stage.pop(frames[purger.nfrms++]);
+    }
+    return;
+  }
+
+  mex_duration_t tnext;
+  while (peek_time(reader, spec, tnext) && tnext < t)
+  {
+    if (frames.size() <= purger.nfrms) add_frame();
+    if (read_next_frame(reader, frames[purger.nfrms], spec)) break;
+    ++purger.nfrms;
+  }
+}
@@ -0,0 +1,376 @@
+#pragma once
+
+#include <mex.h>
+
+#include <cstring>
+
+extern "C"
+{
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/pixfmt.h>
+}
+
+#include <ffmpegException.h>
+#include <ffmpegImageUtils.h>
+
+#include "../../utils/ffmpegImageTranspose.h"
+#include "../../utils/mexGrowableBuffer.h"
+
+/**
+ * \brief Contiguous mexGrowableBuffer-backed block of video frames, adopted by
+ *        the returned mxArray
+ *
+ * Frames are written into the block in MATLAB's W x H x C x N column-major
+ * layout as they are read from the reader, so each AVFrame can be released
+ * as soon as it has been rendered. The block memory is allocated
+ * uninitialized (mexGrowableBuffer) and adopted by the returned mxArray.
+ *
+ * Frames are either post-op output frames (already transposed and in a
+ * component format) or, if the block is given a destination pixel format,
+ * decoded frames that are converted and transposed natively by
+ * ffmpeg::imageTransposeToComponentBuffer() straight into the block. The
+ * default rgb24 & gray outputs (and their uint16 & single variants) always
+ * take the latter path, with an untransposed post-op ahead of it if needed.
+ *
+ * Only the other VideoFormats ('native' or a format the native converter does
+ * not produce) are transposed by the post-op. Its output frame is owned by
+ * the filter graph, so it is still copied once into the block by
+ * ffmpeg::imageCopyToComponentBuffer(). The class of the block follows the
+ * component format: uint8, uint16 (more than 8 bits), or single (float).
+ */
+class mexVideoBlock
+{
+  public:
+  /**
+   * \param[in] capacity  Expected number of frames (the block grows past it
+   *                      if needed)
+   * \param[in] dst_fmt   Native conversion format (AV_PIX_FMT_NONE if the
+   *                      frames are post-op output)
+   */
+  mexVideoBlock(const size_t capacity,
+                const AVPixelFormat dst_fmt = AV_PIX_FMT_NONE)
+      : capacity(capacity), nframes(0), frame_size(0), dst_fmt(dst_fmt)
+  {
+  }
+
+  /**
+   * \brief Render the frame at the end of the block
+   *
+   * The first frame determines the frame dimensions and format of the block,
+   * and the block memory is allocated at that time.
+   *
+   * \param[in] frame   Post-op output frame (transposed, component format)
+   *                    or decoded frame if native conversion
+   * \throws ffmpeg::Exception if the frame does not match the first frame
+   */
+  void append(const AVFrame *frame)
+  {
+    uint8_t *dst = next(frame->format, frame->width, frame->height);
+    render(dst, frame_size, frame, dst_fmt);
+    ++nframes;
+  }
+
+  /**
+   * \brief Copy a frame already rendered by render() at the end of the block
+   *
+   * \param[in] fmt, w, h  Format & dimensions of the frame as it was rendered
+   * \param[in] rendered   get_frame_size() bytes of the rendered frame
+   */
+  void append(const int fmt, const int w, const int h, const uint8_t *rendered)
+  {
+    std::memcpy(next(fmt, w, h), rendered, frame_size);
+    ++nframes;
+  }
+
+  /**
+   * \brief Returns the number of bytes of a rendered frame
+   */
+  static size_t get_frame_size(const AVPixelFormat fmt, const int w,
+                               const int h, const AVPixelFormat dst_fmt)
+  {
+    return dst_fmt == AV_PIX_FMT_NONE
+               ? ffmpeg::imageGetComponentBufferSize(fmt, w, h)
+               : ffmpeg::imageTransposeGetBufferSize(dst_fmt, w, h);
+  }
+
+  /**
+   * \brief Render a frame into a buffer of get_frame_size() bytes (thread-safe,
+   *        no MEX API call)
+   */
+  static void render(uint8_t *dst, const size_t size, const AVFrame *frame,
+                     const AVPixelFormat dst_fmt)
+  {
+    if (dst_fmt == AV_PIX_FMT_NONE)
+      ffmpeg::imageCopyToComponentBuffer(dst, (int)size, frame->data,
+                                         frame->linesize,
+                                         (AVPixelFormat)frame->format,
+                                         frame->width, frame->height);
+    else
+      ffmpeg::imageTransposeToComponentBuffer(dst, frame, dst_fmt);
+  }
+
+  /**
+   * \brief Number of frames rendered so far
+   */
+  size_t size() const { return nframes; }
+
+  /**
+   * \brief Number of bytes rendered so far
+   */
+  size_t bytes() const { return nframes * frame_size; }
+
+  /**
+   * \brief Hand the block over to a new mxArray
+   *
+   * Unused trailing capacity (e.g., eof reached early) is trimmed before the
+   * hand-off.
+   *
+   * \returns W x H x C x N uint8, uint16, or single mxArray (0x0 uint8 if no
+   *          frame was rendered)
+   */
+  mxArray *release()
+  {
+    mxArray *mxData = mxCreateNumericMatrix(
+        0, 0, nframes ? mx_class : mxUINT8_CLASS, mxREAL);
+    if (!nframes) return mxData;
+
+    dims[3] = (mwSize)nframes;
+    mxSetDimensions(mxData, dims, 4);
+    mxSetData(mxData, buf.release());
+    return mxData;
+  }
+
+  private:
+  // returns the block memory of the next frame, allocated by the first frame
+  uint8_t *next(const int fmt, const int w, const int h)
+  {
+    if (!frame_size)
+    {
+      format = (AVPixelFormat)fmt;
+      width = w;
+      height = h;
+      frame_size = get_frame_size(format, width, height, dst_fmt);
+      if (dst_fmt == AV_PIX_FMT_NONE)
+      {
+        dims[0] = (mwSize)width;
+        dims[1] = (mwSize)height;
+      }
+      else // native conversion transposes the frame
+      {
+        dims[0] = (mwSize)height;
+        dims[1] = (mwSize)width;
+      }
+      mx_class = get_class(dst_fmt == AV_PIX_FMT_NONE ? format : dst_fmt);
+      dims[2] = (mwSize)(frame_size / ((size_t)width * height *
+                                       (mx_class == mxUINT8_CLASS    ? 1
+                                        : mx_class == mxUINT16_CLASS ? 2
+                                                                     : 4)));
+      buf.reset(frame_size, 1, capacity);
+    }
+    else if (fmt != format || w != width || h != height)
+      throw ffmpeg::Exception("Video frame size or format changed mid-block.");
+    return buf.append();
+  }
+
+  // MATLAB class of the components: single if float, uint16 if more than 8
+  // bits, else uint8
+  static mxClassID get_class(const AVPixelFormat fmt)
+  {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+    if (desc->flags & AV_PIX_FMT_FLAG_FLOAT) return mxSINGLE_CLASS;
+    return desc->comp[0].depth > 8 ? mxUINT16_CLASS : mxUINT8_CLASS;
+  }
+
+  mexGrowableBuffer buf; // block memory (a frame per row)
+  size_t capacity;       // expected number of frames in the block
+  size_t nframes;        // number of frames rendered
+  size_t frame_size; // number of bytes per frame
+  AVPixelFormat dst_fmt; // AV_PIX_FMT_NONE if frames are post-op output
+  AVPixelFormat format;
+  mxClassID mx_class;
+  int width, height;
+  mwSize dims[4];
+};
+
+/**
+ * \brief Block of video frames output as separate component planes
+ *
+ * Each component (e.g., Y, U, and V) is rendered into its own contiguous
+ * mexGrowableBuffer-backed block at its native resolution, i.e., the chroma
+ * planes are not resampled, as an H x W x N uint8 (8-bit) or uint16 array of
+ * the raw samples. The blocks are handed over to the fields of a scalar
+ * struct, named after the components of the pixel format.
+ */
+class mexPlanesBlock
+{
+  public:
+  /**
+   * \param[in] capacity  Expected number of frames (the block grows past it
+   *                      if needed)
+   */
+  mexPlanesBlock(const size_t capacity)
+      : capacity(capacity), nframes(0), ncomp(0)
+  {
+  }
+
+  /**
+   * \brief Render the planes of the frame at the end of the block
+   *
+   * The first frame determines the frame dimensions and format of the block,
+   * and the block memory is allocated at that time.
+   *
+   * \param[in] frame   Decoded (or post-op output) frame, not transposed
+   * \throws ffmpeg::Exception if the frame does not match the first frame
+   */
+  void append(const AVFrame *frame)
+  {
+    setup(frame->format, frame->width, frame->height);
+    for (int c = 0; c < ncomp; ++c)
+      ffmpeg::imageTransposeComponentPlane(planes[c].buf.append(), frame, c);
+    ++nframes;
+  }
+
+  /**
+   * \brief Copy a frame already rendered by render() at the end of the block
+   *
+   * \param[in] fmt, w, h  Format & dimensions of the frame as it was rendered
+   * \param[in] rendered   get_frame_size() bytes of the rendered frame
+   */
+  void append(const int fmt, const int w, const int h, const uint8_t *rendered)
+  {
+    setup(fmt, w, h);
+    for (int c = 0; c < ncomp; ++c)
+    {
+      std::memcpy(planes[c].buf.append(), rendered, planes[c].size);
+      rendered += planes[c].size;
+    }
+    ++nframes;
+  }
+
+  /**
+   * \brief Returns the number of bytes of a rendered frame (all planes)
+   */
+  static size_t get_frame_size(const AVPixelFormat fmt, const int w,
+                               const int h)
+  {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+    size_t size = 0;
+    for (int c = 0; c < desc->nb_components; ++c)
+      size += get_plane_size(fmt, c, w, h);
+    return size;
+  }
+
+  /**
+   * \brief Render the planes of a frame back-to-back into a buffer of
+   *        get_frame_size() bytes (thread-safe, no MEX API call)
+   */
+  static void render(uint8_t *dst, const AVFrame *frame)
+  {
+    AVPixelFormat fmt = (AVPixelFormat)frame->format;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+    for (int c = 0; c < desc->nb_components; ++c)
+    {
+      ffmpeg::imageTransposeComponentPlane(dst, frame, c);
+      dst += get_plane_size(fmt, c, frame->width, frame->height);
+    }
+  }
+
+  /**
+   * \brief Number of frames rendered so far
+   */
+  size_t size() const { return nframes; }
+
+  /**
+   * \brief Number of bytes rendered so far
+   */
+  size_t bytes() const
+  {
+    size_t n = 0;
+    for (int c = 0; c < ncomp; ++c) n += nframes * planes[c].size;
+    return n;
+  }
+
+  /**
+   * \brief Hand the planes over to a new struct
+   *
+   * \returns scalar struct with a H x W x N field per component: Y, U, V (&
+   *          A) for YUV, R, G, B (& A) for RGB, or Y (& A) for grayscale
+   *          formats (0x0 uint8 if no frame was rendered)
+   */
+  mxArray *release()
+  {
+    if (!nframes) return mxCreateNumericMatrix(0, 0, mxUINT8_CLASS, mxREAL);
+
+    static const char *yuv_names[] = {"Y", "U", "V", "A"};
+    static const char *rgb_names[] = {"R", "G", "B", "A"};
+    static const char *gray_names[] = {"Y", "A"};
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    const char **names = ncomp < 3 ? gray_names
+                         : desc->flags & AV_PIX_FMT_FLAG_RGB ? rgb_names
+                                                             : yuv_names;
+
+    mxArray *mxData = mxCreateStructMatrix(1, 1, ncomp, names);
+    for (int c = 0; c < ncomp; ++c)
+    {
+      Plane &p = planes[c];
+      mxArray *mxPlane = mxCreateNumericMatrix(0, 0, p.mx_class, mxREAL);
+      p.dims[2] = (mwSize)nframes;
+      mxSetDimensions(mxPlane, p.dims, 3);
+      mxSetData(mxPlane, p.buf.release());
+      mxSetFieldByNumber(mxData, 0, c, mxPlane);
+    }
+    return mxData;
+  }
+
+  private:
+  static size_t get_plane_size(const AVPixelFormat fmt, const int c,
+                               const int width, const int height)
+  {
+    int w, h;
+    ffmpeg::imageTransposeGetPlaneSize(fmt, width, height, c, w, h);
+    bool wide = av_pix_fmt_desc_get(fmt)->comp[c].depth > 8;
+    return (size_t)w * h * (wide ? 2 : 1);
+  }
+
+  // allocate the planes by the first frame
+  void setup(const int fmt, const int w, const int h)
+  {
+    if (!ncomp)
+    {
+      format = (AVPixelFormat)fmt;
+      width = w;
+      height = h;
+      const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+      for (int c = 0; c < desc->nb_components; ++c)
+      {
+        Plane &p = planes[c];
+        int pw, ph;
+        ffmpeg::imageTransposeGetPlaneSize(format, width, height, c, pw, ph);
+        p.mx_class = desc->comp[c].depth > 8 ? mxUINT16_CLASS : mxUINT8_CLASS;
+        p.size = get_plane_size(format, c, width, height);
+        p.dims[0] = (mwSize)ph;
+        p.dims[1] = (mwSize)pw;
+        p.buf.reset(p.size, 1, capacity);
+        ++ncomp;
+      }
+    }
+    else if (fmt != format || w != width || h != height)
+      throw ffmpeg::Exception("Video frame size or format changed mid-block.");
+  }
+
+  struct Plane
+  {
+    mexGrowableBuffer buf; // plane block memory (a frame per row)
+    size_t size;           // number of bytes per frame
+    mwSize dims[3];
+    mxClassID mx_class;
+  };
+
+  size_t capacity; // expected number of frames in the block
+  size_t nframes;  // number of frames rendered
+  int ncomp;       // number of components (planes)
+  Plane planes[4];
+  AVPixelFormat format;
+  int width, height;
+};
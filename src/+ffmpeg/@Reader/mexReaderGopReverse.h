@@ -0,0 +1,271 @@
+#pragma once
+
+#include <ffmpegAVFrameDoubleBuffer.h>
+#include <ffmpegException.h>
+#include <ffmpegPtrs.h>
+#include <ffmpegReaderMT.h>
+
+#include "../../utils/ffmpegPacketIndex.h"
+
+extern "C"
+{
+#include <libavutil/frame.h>
+}
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * \brief GOP-cached reverse reader
+ *
+ * mexGopReverseReader reads a single (unfiltered) video stream backward by
+ * decoding each group of pictures (GOP) forward only once into a cache, and
+ * then serving its frames from the cache in reverse order. While the current
+ * GOP is being drained, a worker thread seeks to and decodes the preceding
+ * GOP, so a prefetched GOP is usually ready by the time it is needed.
+ *
+ * GOP boundaries come from the packet index. A GOP longer than the cache
+ * capacity is processed in capacity-sized chunks from its end, each chunk
+ * decoded from the GOP's keyframe, so that at most two chunks (the one being
+ * served and the prefetched one) are held in memory.
+ *
+ * The class is a drop-in for the forward reader in mexFFmpegReader's reader
+ * variant: it hides the frame-consuming member functions of the forward
+ * reader (readNextFrame, getTimeStamp, atEndOfStream, getNumBufferedFrames,
+ * and seek) while the stream setup is inherited. The worker thread is the
+ * only user of the inherited forward reading functions once started.
+ */
+class mexGopReverseReader
+    : public ffmpeg::ReaderMT<ffmpeg::AVFrameDoubleBufferMT>
+{
+  typedef ffmpeg::ReaderMT<ffmpeg::AVFrameDoubleBufferMT> base;
+  typedef std::chrono::duration<double> duration_t;
+
+  public:
+  mexGopReverseReader(const std::string &url)
+      : index(nullptr), st(-1), capacity(0), gen(0), next_end(0),
+        busy(false), killnow(false)
+  {
+    openFile(url);
+  }
+  ~mexGopReverseReader()
+  {
+    {
+      std::unique_lock<std::mutex> lk(mtx);
+      killnow = true;
+    }
+    cv.notify_all();
+    if (worker.joinable()) worker.join();
+    clear();
+  }
+
+  /**
+   * \brief Start reverse reading from the end of the stream
+   *
+   * \param[in] idx    Packet index of the file (must outlive the reader)
+   * \param[in] id     File stream id of the video stream
+   * \param[in] sp     Specifier of the video stream (the primary stream)
+   * \param[in] ncache Maximum number of frames per cached GOP chunk
+   */
+  void start(const ffmpeg::PacketIndex &idx, const int id,
+             const std::string &sp, const size_t ncache)
+  {
+    index = &idx;
+    st = id;
+    spec = sp;
+    capacity = std::max<size_t>(ncache, 1);
+    next_end = index->getNumberOfFrames(st);
+    worker = std::thread(&mexGopReverseReader::decode_gops, this);
+  }
+
+  bool readNextFrame(AVFrame *frame, const std::string &sp)
+  {
+    if (sp != spec) return base::readNextFrame(frame, sp);
+    std::unique_lock<std::mutex> lk(mtx);
+    if (!wait_for_frame(lk)) return true;
+    auto &f = current.back();
+    av_frame_move_ref(frame, f.first);
+    av_frame_free(&f.first);
+    current.pop_back();
+    return false;
+  }
+
+  template <typename Chrono_t = duration_t>
+  Chrono_t getTimeStamp(const std::string &sp)
+  {
+    if (sp != spec) return base::getTimeStamp<Chrono_t>(sp);
+    std::unique_lock<std::mutex> lk(mtx);
+    if (!wait_for_frame(lk))
+      throw ffmpeg::Exception("No more frames available to read.");
+    return std::chrono::duration_cast<Chrono_t>(
+        duration_t(current.back().second));
+  }
+
+  bool atEndOfStream(const std::string &sp)
+  {
+    if (sp != spec) return base::atEndOfStream(sp);
+    std::unique_lock<std::mutex> lk(mtx);
+    return !wait_for_frame(lk);
+  }
+
+  size_t getNumBufferedFrames(const std::string &sp)
+  {
+    if (sp != spec) return base::getNumBufferedFrames(sp);
+    std::unique_lock<std::mutex> lk(mtx);
+    return current.size();
+  }
+
+  /**
+   * \brief Position the reader so the next frame is the last frame presented
+   *        at or before time t
+   */
+  template <class Chrono_t> void seek(const Chrono_t t, const bool = true)
+  {
+    double ts = std::chrono::duration_cast<duration_t>(t).count();
+    {
+      std::unique_lock<std::mutex> lk(mtx);
+      clear();
+      ++gen; // invalidates the chunk being decoded
+      next_end = index->findFrame(st, ts) + 1;
+    }
+    cv.notify_all();
+  }
+
+  private:
+  typedef std::vector<std::pair<AVFrame *, double>> chunk_t;
+
+  // wait until the current chunk has a frame, returns false if none left
+  bool wait_for_frame(std::unique_lock<std::mutex> &lk)
+  {
+    while (current.empty())
+    {
+      if (eptr) std::rethrow_exception(std::exchange(eptr, nullptr));
+      if (ready.size())
+      {
+        current = std::move(ready.front());
+        ready.pop_front();
+        cv.notify_all(); // let the worker prefetch the next chunk
+      }
+      else if (!next_end && !busy)
+        return false;
+      else
+        cv.wait(lk);
+    }
+    return true;
+  }
+
+  // worker thread: decode the chunks from the end, one chunk ahead
+  void decode_gops()
+  {
+    std::unique_lock<std::mutex> lk(mtx);
+    while (true)
+    {
+      cv.wait(lk, [this] { return killnow || (next_end && ready.empty()); });
+      if (killnow) break;
+
+      // chunk [c, b): the last frames before next_end, within one GOP
+      size_t b = next_end;
+      size_t a = index->getKeyFrame(st, b - 1);
+      size_t c = std::max(a, b > capacity ? b - capacity : 0);
+      size_t g = gen;
+      next_end = c;
+      busy = true;
+
+      chunk_t chunk;
+      lk.unlock();
+      try
+      {
+        decode_chunk(chunk, a, c, b);
+      }
+      catch (...)
+      {
+        lk.lock();
+        eptr = std::current_exception();
+        if (g == gen) next_end = 0; // stop at the failed chunk till seeked
+        busy = false;
+        free_chunk(chunk);
+        cv.notify_all();
+        continue;
+      }
+      lk.lock();
+
+      busy = false;
+      if (g == gen)
+        ready.push_back(std::move(chunk));
+      else // seeked while decoding
+        free_chunk(chunk);
+      cv.notify_all();
+    }
+  }
+
+  // decode frames [c, b) by reading forward from keyframe a
+  void decode_chunk(chunk_t &chunk, const size_t a, const size_t c,
+                    const size_t b)
+  {
+    base::seek(duration_t(index->getFrameTime(st, a)), false);
+
+    // frame c is the first frame past the midpoint from its predecessor
+    ffmpeg::AVFramePtr frame(av_frame_alloc(), ffmpeg::delete_av_frame);
+    if (!frame) throw ffmpeg::Exception("Failed to allocate an AVFrame.");
+    if (c)
+    {
+      duration_t t((index->getFrameTime(st, c - 1) +
+                    index->getFrameTime(st, c)) /
+                   2.0);
+      while (!base::atEndOfStream(spec) &&
+             base::getTimeStamp<duration_t>(spec) < t)
+      {
+        base::readNextFrame(frame.get(), spec);
+        av_frame_unref(frame.get());
+      }
+    }
+
+    chunk.reserve(b - c);
+    for (size_t i = c; i < b; ++i)
+    {
+      if (base::readNextFrame(frame.get(), spec)) break;
+      chunk.emplace_back(frame.release(), index->getFrameTime(st, i));
+      frame.reset(av_frame_alloc());
+      if (!frame) throw ffmpeg::Exception("Failed to allocate an AVFrame.");
+    }
+  }
+
+  static void free_chunk(chunk_t &chunk)
+  {
+    for (auto &f : chunk) av_frame_free(&f.first);
+    chunk.clear();
+  }
+
+  // discard all the cached frames (mtx must be locked)
+  void clear()
+  {
+    free_chunk(current);
+    for (auto &chunk : ready) free_chunk(chunk);
+    ready.clear();
+  }
+
+  const ffmpeg::PacketIndex *index;
+  int st;           // file stream id
+  std::string spec; // stream specifier
+  size_t capacity;  // max. frames per chunk
+
+  std::thread worker;
+  std::mutex mtx;
+  std::condition_variable cv;
+  size_t gen;         // incremented on seek
+  size_t next_end;    // frames [0, next_end) are yet to be decoded
+  bool busy;          // true while the worker decodes a chunk
+  bool killnow;       // true to stop the worker
+  std::exception_ptr eptr; // exception thrown by the worker
+
+  chunk_t current;           // chunk being served (from its back)
+  std::deque<chunk_t> ready; // prefetched chunk
+};
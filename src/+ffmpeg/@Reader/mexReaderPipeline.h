@@ -0,0 +1,233 @@
+#pragma once
+
+#include <ffmpegException.h>
+
+extern "C"
+{
+#include <libavutil/frame.h>
+}
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * \brief Background conversion pipeline of the primary video stream
+ *
+ * With a single video stream, the conversion of the decoded frames into the
+ * MATLAB layout (post-op filtering, native transpose/conversion, or plane
+ * extraction) is moved off the MATLAB thread: a worker thread reads the
+ * frames from the reader and renders each into a plain buffer as soon as it
+ * is decoded, keeping up to capacity rendered frames ahead of the reads.
+ * MATLAB thread then only copies the rendered frames into the output block.
+ *
+ * The worker never calls the MEX API (which is not thread-safe): the
+ * renderers only write into the buffers given to them, and the buffers are
+ * recycled through a pool so that steady-state reading does not allocate.
+ *
+ * While the pipeline runs, the worker is the only user of the reader;
+ * stop() must be called before the reader is accessed otherwise (e.g., to
+ * seek), and start() to resume.
+ */
+class mexConvertPipeline
+{
+  public:
+  struct Frame
+  {
+    std::vector<uint8_t> data; // rendered frame
+    int format;                // format & dimensions of the source frame
+    int width, height;
+    double t;    // timestamp in seconds
+    int64_t pts; // best-effort pts in the stream time base
+  };
+
+  /**
+   * \brief Read the next frame to be rendered
+   *
+   * \param[out] frame  Unreferenced AVFrame to receive the frame
+   * \param[out] t      Timestamp of the frame in seconds
+   * \returns true if eof (no frame)
+   */
+  typedef std::function<bool(AVFrame *frame, double &t)> Source;
+
+  /**
+   * \brief Render a frame into the buffer (resized by the renderer)
+   */
+  typedef std::function<void(std::vector<uint8_t> &dst, const AVFrame *frame)>
+      Renderer;
+
+  mexConvertPipeline(const size_t capacity, Source source, Renderer renderer)
+      : capacity(std::max<size_t>(capacity, 1)), source(std::move(source)),
+        renderer(std::move(renderer)), eof(false), killnow(false)
+  {
+  }
+  ~mexConvertPipeline() { stop(); }
+
+  /**
+   * \brief (Re)start rendering frames from the current position of the reader
+   *        (the frames rendered so far are discarded)
+   */
+  void start()
+  {
+    stop();
+    std::unique_lock<std::mutex> lk(mtx);
+    eof = killnow = false;
+    worker = std::thread(&mexConvertPipeline::convert_frames, this);
+  }
+
+  /**
+   * \brief Stop the worker and discard all the rendered frames
+   */
+  void stop()
+  {
+    {
+      std::unique_lock<std::mutex> lk(mtx);
+      killnow = true;
+    }
+    cv.notify_all();
+    if (worker.joinable()) worker.join();
+
+    std::unique_lock<std::mutex> lk(mtx);
+    while (ready.size()) recycle();
+    eptr = nullptr;
+  }
+
+  /**
+   * \brief Wait until the next rendered frame is available
+   *
+   * \returns false if no frame is left (eof)
+   * \throws the exception thrown by the worker thread, if any
+   */
+  bool wait()
+  {
+    std::unique_lock<std::mutex> lk(mtx);
+    cv.wait(lk, [this] { return ready.size() || eof || eptr; });
+    if (ready.size()) return true;
+    if (eptr) std::rethrow_exception(std::exchange(eptr, nullptr));
+    return false;
+  }
+
+  /**
+   * \brief Number of rendered frames ready to be read
+   */
+  size_t size()
+  {
+    std::unique_lock<std::mutex> lk(mtx);
+    return ready.size();
+  }
+
+  /**
+   * \brief Next rendered frame (wait() must have returned true)
+   */
+  const Frame &front()
+  {
+    std::unique_lock<std::mutex> lk(mtx);
+    return ready.front();
+  }
+
+  /**
+   * \brief Release the next rendered frame
+   */
+  void pop()
+  {
+    {
+      std::unique_lock<std::mutex> lk(mtx);
+      recycle();
+    }
+    cv.notify_all(); // let the worker render another
+  }
+
+  private:
+  // move the front frame's buffer to the pool (mtx must be locked)
+  void recycle()
+  {
+    pool.push_back(std::move(ready.front().data));
+    ready.pop_front();
+  }
+
+  // worker thread: read & render the frames, up to capacity ahead
+  void convert_frames()
+  {
+    AVFrame *frame = av_frame_alloc();
+    std::unique_lock<std::mutex> lk(mtx);
+    if (!frame)
+    {
+      eptr = std::make_exception_ptr(
+          ffmpeg::Exception("Failed to allocate an AVFrame."));
+      cv.notify_all();
+      return;
+    }
+
+    while (true)
+    {
+      cv.wait(lk, [this] { return killnow || ready.size() < capacity; });
+      if (killnow) break;
+
+      Frame f;
+      if (pool.size())
+      {
+        f.data = std::move(pool.back());
+        pool.pop_back();
+      }
+
+      lk.unlock();
+      bool done = false;
+      try
+      {
+        done = source(frame, f.t);
+        if (!done)
+        {
+          renderer(f.data, frame);
+          f.format = frame->format;
+          f.width = frame->width;
+          f.height = frame->height;
+          f.pts = frame->best_effort_timestamp != AV_NOPTS_VALUE
+                      ? frame->best_effort_timestamp
+                      : frame->pts;
+          av_frame_unref(frame);
+        }
+      }
+      catch (...)
+      {
+        av_frame_unref(frame);
+        lk.lock();
+        eptr = std::current_exception();
+        cv.notify_all();
+        break;
+      }
+      lk.lock();
+
+      if (done)
+      {
+        pool.push_back(std::move(f.data));
+        eof = true;
+        cv.notify_all();
+        break;
+      }
+      ready.push_back(std::move(f));
+      cv.notify_all();
+    }
+    av_frame_free(&frame);
+  }
+
+  size_t capacity; // max. number of rendered frames
+  Source source;
+  Renderer renderer;
+
+  std::thread worker;
+  std::mutex mtx;
+  std::condition_variable cv;
+  bool eof;                // true if the worker reached the end of stream
+  bool killnow;            // true to stop the worker
+  std::exception_ptr eptr; // exception thrown by the worker
+
+  std::deque<Frame> ready;                // rendered frames
+  std::vector<std::vector<uint8_t>> pool; // recycled frame buffers
+};
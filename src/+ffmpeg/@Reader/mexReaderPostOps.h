@@ -9,6 +9,7 @@
 extern "C"
 {
 #include <libavutil/pixdesc.h>
+#include <libavutil/rational.h>
 #include <libavutil/pixfmt.h>
 #include <libavutil/samplefmt.h>
 }
@@ -19,21 +20,39 @@ extern "C"
 #include <ffmpegPostOp.h>
 #include <filter/ffmpegFilterGraph.h>
 
+#include "mexReaderStats.h"
+
 /**
  * \brief a FFmpeg video filter to convert a video AVFrame to desired format &
  * orientation
+ *
+ * If scale > 1, the frame is also downscaled by the factor (area averaging).
+ * The scale filter is placed first so that the downscale and the format
+ * conversion are performed in one swscale pass, ahead of the transpose.
+ *
+ * If transpose is false, the output frames are left untransposed for the
+ * native converter (see mexVideoBlock) to transpose.
+ *
+ * If stats is given, the filtering is timed & counted on it.
  */
 class mexFFmpegVideoPostOp : public ffmpeg::PostOpInterface
 {
   public:
   mexFFmpegVideoPostOp(ffmpeg::IAVFrameSourceBuffer &src,
-                       const AVPixelFormat pixfmt)
-      : out(1)
+                       const AVPixelFormat pixfmt, const int scale = 1,
+                       const bool transpose = true,
+                       mexReaderStats::Counter *stats = nullptr)
+      : out(1), stats(stats)
   {
     // create filter graph
     std::ostringstream ssout;
-    ssout << "[in]transpose,format=pix_fmts=" << av_get_pix_fmt_name(pixfmt)
-          << "[out]";
+    ssout << "[in]";
+    if (scale > 1)
+      ssout << "scale=w=ceil(iw/" << scale << "):h=ceil(ih/" << scale
+            << "):flags=area,format=pix_fmts=" << av_get_pix_fmt_name(pixfmt)
+            << ",";
+    ssout << (transpose ? "transpose," : "")
+          << "format=pix_fmts=" << av_get_pix_fmt_name(pixfmt) << "[out]";
     fg = ffmpeg::filter::Graph(ssout.str());
 
     // Link filter graph to the in/out buffers
@@ -47,10 +66,12 @@ class mexFFmpegVideoPostOp : public ffmpeg::PostOpInterface
 
   bool filter(AVFrame *dst) override
   {
+    mexReaderStats::Scope timer(stats);
     bool eof;
     if (!fg.processFrame())
       throw ffmpeg::Exception("Post video filter produced no frame!.");
     out.pop(dst, &eof);
+    if (!eof) timer.count(1, mexReaderStats::frame_bytes(dst));
     return eof;
   }
 
@@ -59,23 +80,42 @@ class mexFFmpegVideoPostOp : public ffmpeg::PostOpInterface
   ffmpeg::AVFrameQueue<NullMutex, NullConditionVariable<NullMutex>,
                        NullUniqueLock<NullMutex>>
       out;
+  mexReaderStats::Counter *stats;
 };
 
 /**
- * \brief a FFmpeg audio filter to convert a video AVFrame to desired format &
- * orientation
+ * \brief a FFmpeg audio filter to convert an audio AVFrame to desired sample
+ * format, and optionally sample rate and channel layout
+ *
+ * The resampling & remixing are performed by swresample (aresample). As its
+ * output is timestamped in 1/sample_rate, the frames are rescaled back to
+ * the source time base tb so their pts stay in the stream's time base.
+ *
+ * Like every post-op, the filtering runs on the thread reading the frame
+ * (i.e., MATLAB's), as the reader threads only decode ahead. Unlike video
+ * (mexConvertPipeline), audio is not moved to a worker thread.
  */
 class mexFFmpegAudioPostOp : public ffmpeg::PostOpInterface
 {
   public:
   mexFFmpegAudioPostOp(ffmpeg::IAVFrameSourceBuffer &src,
-                       const AVSampleFormat samplefmt)
-      : out(1)
+                       const AVSampleFormat samplefmt,
+                       const int sample_rate = 0,
+                       const std::string channel_layout = "",
+                       const AVRational tb = {0, 1},
+                       mexReaderStats::Counter *stats = nullptr)
+      : src(src), out(1), stats(stats)
   {
     // create filter graph
     std::ostringstream ssout;
-    ssout << "[in]aformat=sample_fmts=" << av_get_sample_fmt_name(samplefmt)
-          << "[out]";
+    ssout << "[in]";
+    if (sample_rate) ssout << "aresample=" << sample_rate << ",";
+    ssout << "aformat=sample_fmts=" << av_get_sample_fmt_name(samplefmt);
+    if (sample_rate) ssout << ":sample_rates=" << sample_rate;
+    if (channel_layout.size()) ssout << ":channel_layouts=" << channel_layout;
+    if ((sample_rate || channel_layout.size()) && tb.num)
+      ssout << ",asettb=tb=" << tb.num << "/" << tb.den;
+    ssout << "[out]";
     fg = ffmpeg::filter::Graph(ssout.str());
 
     // Link filter graph to the in/out buffers
@@ -89,16 +129,32 @@ class mexFFmpegAudioPostOp : public ffmpeg::PostOpInterface
 
   bool filter(AVFrame *dst) override
   {
+    mexReaderStats::Scope timer(stats);
     bool eof;
-    if (!fg.processFrame())
-      throw ffmpeg::Exception("Post video filter produced no frame!.");
+    // the resampler may hold back the samples of an input frame (its delay),
+    // so keep feeding the graph until a frame comes out. The source eof
+    // flushes the held-back samples out of the graph ahead of the eof, one
+    // frame per call.
+    while (!out.readyToPop())
+    {
+      if (fg.processFrame() || src.readyToPop()) continue;
+
+      // a multithreaded source may be only momentarily empty: wait for the
+      // decoder to deliver the next frame unless the source is exhausted
+      if (src.eof())
+        throw ffmpeg::Exception("Post audio filter produced no frame!.");
+      src.blockTillReadyToPop();
+    }
     out.pop(dst, &eof);
+    if (!eof) timer.count(1, mexReaderStats::frame_bytes(dst));
     return eof;
   }
 
   private:
+  ffmpeg::IAVFrameSourceBuffer &src;
   ffmpeg::filter::Graph fg;
   ffmpeg::AVFrameQueue<NullMutex, NullConditionVariable<NullMutex>,
                        NullUniqueLock<NullMutex>>
       out;
+  mexReaderStats::Counter *stats;
 };
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <deque>
+#include <utility>
+
+extern "C"
+{
+#include <libavutil/frame.h>
+}
+
+#include <ffmpegException.h>
+
+#include "../../utils/ffmpegFrameSpill.h"
+
+/**
+ * \brief Bounded staging buffer of a secondary stream
+ *
+ * Secondary streams are dynamically buffered by the reader, so a stream
+ * that is rarely drained grows without limit. The frames of a bounded stream
+ * are moved out of the reader into its staging buffer every time the primary
+ * stream is read. With the 'drop-oldest' and 'spill' policies, the staging
+ * buffer holds at most its capacity in memory: the oldest frames are either
+ * discarded or spilled to a temporary file (and restored in order when the
+ * stream is read).
+ *
+ * The 'error' policy does not drop or spill any frame. The reader itself
+ * cannot be paused on a full secondary stream, as it would then never
+ * deliver the primary frame the caller waits for (e.g., if the stream is not
+ * read at all), so a stream falling more than its capacity behind the
+ * primary stream is reported by lagging() for the reader to raise an error.
+ * Until then, the stage holds at most its capacity of frames preceding the
+ * last primary frame plus the frames interleaved ahead of it.
+ */
+class mexFrameStage
+{
+  public:
+  enum class Policy
+  {
+    Error,
+    DropOldest,
+    Spill
+  };
+
+  mexFrameStage(const size_t capacity, const Policy policy)
+      : capacity(capacity), policy(policy), ndropped(0)
+  {
+  }
+  mexFrameStage(const mexFrameStage &) = delete;
+  mexFrameStage(mexFrameStage &&) = default;
+  ~mexFrameStage() { clear(); }
+
+  /**
+   * \brief Append a frame, enforcing the capacity
+   *
+   * \param[in] frame  Frame allocated by av_frame_alloc() (takes ownership)
+   * \param[in] t      Timestamp of the frame in seconds
+   */
+  void push(AVFrame *frame, const double t)
+  {
+    frames.emplace_back(frame, t);
+    if (policy == Policy::Error || frames.size() <= capacity) return;
+
+    auto &oldest = frames.front();
+    if (policy == Policy::Spill)
+    {
+      spill.push(oldest.first, oldest.second);
+      spilled_t.push_back(oldest.second);
+    }
+    else
+      ++ndropped;
+    av_frame_free(&oldest.first);
+    frames.pop_front();
+  }
+
+  /**
+   * \brief Number of staged frames (in memory & spilled)
+   */
+  size_t size() const { return spill.size() + frames.size(); }
+  bool empty() const { return !size(); }
+
+  /**
+   * \brief Returns true if more than capacity frames of an 'error' policy
+   *        stage precede time t, i.e., the stream is not read along with the
+   *        primary stream whose last frame was at t
+   */
+  bool lagging(const double t) const
+  {
+    return policy == Policy::Error && frames.size() > capacity &&
+           frames[capacity].second < t;
+  }
+
+  /**
+   * \brief Number of frames discarded by the 'drop-oldest' policy
+   */
+  size_t dropped() const { return ndropped; }
+
+  /**
+   * \brief Timestamp of the oldest staged frame in seconds
+   */
+  double front_time() const
+  {
+    if (spilled_t.size()) return spilled_t.front();
+    if (frames.empty()) throw ffmpeg::Exception("No staged frame.");
+    return frames.front().second;
+  }
+
+  /**
+   * \brief Remove the oldest staged frame
+   *
+   * \param[out] dst  Unreferenced AVFrame to receive the frame
+   */
+  void pop(AVFrame *dst)
+  {
+    if (spilled_t.size())
+    {
+      spill.pop(dst);
+      spilled_t.pop_front();
+      return;
+    }
+    if (frames.empty()) throw ffmpeg::Exception("No staged frame.");
+    av_frame_move_ref(dst, frames.front().first);
+    av_frame_free(&frames.front().first);
+    frames.pop_front();
+  }
+
+  /**
+   * \brief Discard all the staged frames (e.g., after seek)
+   */
+  void clear()
+  {
+    for (auto &f : frames) av_frame_free(&f.first);
+    frames.clear();
+    spill.clear();
+    spilled_t.clear();
+  }
+
+  private:
+  size_t capacity; // max. number of frames kept in memory
+  Policy policy;
+  size_t ndropped;
+  std::deque<std::pair<AVFrame *, double>> frames; // in-memory frames & ts
+  ffmpeg::FrameSpill spill;    // frames older than the in-memory frames
+  std::deque<double> spilled_t; // timestamps of the spilled frames
+};
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <mex.h>
+
+extern "C"
+{
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+}
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/**
+ * \brief Per-stage timing & counters of a Reader (CollectStats property)
+ *
+ * Each counter accumulates the wall & CPU time spent in a stage of a stream,
+ * the number of frames & bytes that went through it, and the high-water mark
+ * of its queue. Counters are created while the reader is activated and
+ * updated lock-free afterwards, so they may be updated from the worker
+ * threads (post-ops, conversion pipeline). When disabled, find() returns
+ * nullptr and a Scope costs a single branch.
+ *
+ * Stages:
+ *  - Read:     time the consumer waited on the reader for the next frame;
+ *              MaxQueued: frames buffered by the reader. Demuxing, decoding,
+ *              & the FilterGraph run on the reader's own threads with no
+ *              timing hooks, so they cannot be split into stages of their
+ *              own and surface here combined
+ *  - PostOp:   mexFFmpegVideoPostOp & mexFFmpegAudioPostOp filtering
+ *  - Convert:  rendering the frames into the MATLAB layout; MaxQueued:
+ *              frames converted ahead by the ConversionBufferSize pipeline
+ *  - Copy:     mxArray hand-off & copying of the pre-converted frames
+ *  - Staging:  MaxQueued: frames held by a StreamBufferPolicy staging buffer
+ */
+class mexReaderStats
+{
+  public:
+  struct Counter
+  {
+    std::atomic<int64_t> wall_ns{0}, cpu_ns{0};
+    std::atomic<uint64_t> frames{0}, bytes{0}, max_queued{0};
+
+    void queued(const size_t n)
+    {
+      uint64_t m = max_queued.load(std::memory_order_relaxed);
+      while (n > m && !max_queued.compare_exchange_weak(m, n)) {}
+    }
+  };
+
+  /**
+   * \brief Measures the scope in which it lives, if given a counter
+   */
+  class Scope
+  {
+public:
+    Scope(Counter *c) : c(c)
+    {
+      if (!c) return;
+      t0 = std::chrono::steady_clock::now();
+      cpu0 = thread_cpu_ns();
+    }
+    ~Scope()
+    {
+      if (!c) return;
+      c->wall_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - t0)
+                        .count();
+      c->cpu_ns += thread_cpu_ns() - cpu0;
+    }
+
+    /**
+     * \brief Count frames & bytes processed in the scope
+     */
+    void count(const size_t nframes, const size_t nbytes)
+    {
+      if (!c) return;
+      c->frames += nframes;
+      c->bytes += nbytes;
+    }
+
+    void queued(const size_t n)
+    {
+      if (c) c->queued(n);
+    }
+
+private:
+    Counter *c;
+    std::chrono::steady_clock::time_point t0;
+    int64_t cpu0;
+  };
+
+  mexReaderStats() : enabled(false) {}
+
+  /**
+   * \brief Enable or disable the counters (clears all the counters)
+   */
+  void enable(const bool on)
+  {
+    enabled = on;
+    entries.clear();
+  }
+
+  bool is_enabled() const { return enabled; }
+
+  /**
+   * \brief Create the counter of a stage of a stream (no-op if disabled)
+   *
+   * Must not be called once the counters may be in use by worker threads.
+   */
+  void add(const std::string &stage, const std::string &spec)
+  {
+    if (enabled && !find(stage, spec))
+      entries.push_back(std::make_unique<Entry>(stage, spec));
+  }
+
+  /**
+   * \brief Returns the counter of a stage of a stream (nullptr if disabled or
+   *        not added)
+   */
+  Counter *find(const std::string &stage, const std::string &spec)
+  {
+    if (!enabled) return nullptr;
+    for (auto &e : entries)
+      if (e->stage == stage && e->spec == spec) return &e->counter;
+    return nullptr;
+  }
+
+  /**
+   * \brief Returns the number of data bytes referenced by an AVFrame
+   */
+  static size_t frame_bytes(const AVFrame *frame)
+  {
+    size_t n = 0;
+    for (int i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i]; ++i)
+      n += frame->buf[i]->size;
+    return n;
+  }
+
+  /**
+   * \brief Returns the counters as a struct array (fields: Stage, Stream,
+   *        WallTime, CPUTime, Frames, Bytes, MaxQueued)
+   */
+  mxArray *get() const
+  {
+    const char *fields[] = {"Stage",  "Stream", "WallTime", "CPUTime",
+                            "Frames", "Bytes",  "MaxQueued"};
+    mxArray *mxStats = mxCreateStructMatrix(entries.size(), 1, 7, fields);
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+      const Entry &e = *entries[i];
+      mxSetField(mxStats, i, "Stage", mxCreateString(e.stage.c_str()));
+      mxSetField(mxStats, i, "Stream", mxCreateString(e.spec.c_str()));
+      mxSetField(mxStats, i, "WallTime",
+                 mxCreateDoubleScalar(e.counter.wall_ns * 1e-9));
+      mxSetField(mxStats, i, "CPUTime",
+                 mxCreateDoubleScalar(e.counter.cpu_ns * 1e-9));
+      mxSetField(mxStats, i, "Frames",
+                 mxCreateDoubleScalar((double)e.counter.frames));
+      mxSetField(mxStats, i, "Bytes",
+                 mxCreateDoubleScalar((double)e.counter.bytes));
+      mxSetField(mxStats, i, "MaxQueued",
+                 mxCreateDoubleScalar((double)e.counter.max_queued));
+    }
+    return mxStats;
+  }
+
+  private:
+  struct Entry
+  {
+    Entry(const std::string &stage, const std::string &spec)
+        : stage(stage), spec(spec)
+    {
+    }
+    std::string stage, spec;
+    Counter counter;
+  };
+
+  // CPU time consumed by the calling thread
+  static int64_t thread_cpu_ns()
+  {
+#ifdef _WIN32
+    FILETIME c, e, k, u;
+    GetThreadTimes(GetCurrentThread(), &c, &e, &k, &u);
+    return ((int64_t(k.dwHighDateTime) << 32 | k.dwLowDateTime) +
+            (int64_t(u.dwHighDateTime) << 32 | u.dwLowDateTime)) *
+           100;
+#else
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+  }
+
+  bool enabled;
+  std::vector<std::unique_ptr<Entry>> entries;
+};
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+extern "C"
+{
+#include <libavutil/frame.h>
+#include <libavutil/samplefmt.h>
+}
+
+#include <ffmpegException.h>
+
+#include "../../utils/ffmpegAudioUtils.h"
+
+/**
+ * \brief Overlapping window framer of an audio stream (WindowLength)
+ *
+ * The decoded samples are appended to a per-channel sample buffer, from which
+ * every window of nwin samples starting at a multiple of hop samples is
+ * copied out once to an Nwin x Nch x K block, optionally weighted by a window
+ * function. Only the samples not yet consumed by a window (fewer than
+ * nwin + hop per channel, plus those of the frames of a single read) are
+ * retained, so the memory stays bounded however long the stream is.
+ */
+class mexAudioWindower
+{
+  public:
+  /**
+   * \param[in] nwin   Window length in samples
+   * \param[in] hop    Hop length in samples
+   * \param[in] window Window function (nwin weights, empty: rectangular)
+   */
+  mexAudioWindower(const size_t nwin, const size_t hop,
+                   const std::vector<double> &window)
+      : nwin(nwin), hop(hop), window(window), fmt(AV_SAMPLE_FMT_NONE),
+        nch(0), elsz(0), ld(0), head(0), tail(0), offset(0), primed(false)
+  {
+  }
+
+  /**
+   * \brief Weights of a named window function ('rectangular' yields none)
+   *
+   * The windows are periodic (i.e., DFT-even) as used for STFT analysis.
+   */
+  static std::vector<double> get_window(const std::string &name,
+                                        const size_t n)
+  {
+    std::vector<double> w;
+    if (name == "rectangular") return w;
+
+    double a[3]; // generalized cosine window coefficients
+    if (name == "hann")
+      a[0] = 0.5, a[1] = 0.5, a[2] = 0.0;
+    else if (name == "hamming")
+      a[0] = 0.54, a[1] = 0.46, a[2] = 0.0;
+    else if (name == "blackman")
+      a[0] = 0.42, a[1] = 0.5, a[2] = 0.08;
+    else
+      throw ffmpeg::Exception("Unknown window function: " + name);
+
+    w.resize(n);
+    const double pi = 3.14159265358979323846;
+    for (size_t i = 0; i < n; ++i)
+    {
+      double x = 2.0 * pi * i / n;
+      w[i] = a[0] - a[1] * std::cos(x) + a[2] * std::cos(2.0 * x);
+    }
+    return w;
+  }
+
+  /**
+   * \brief Returns true if the samples of the format can be weighted by a
+   *        window function (floating-point)
+   */
+  static bool weightable(const AVSampleFormat fmt)
+  {
+    AVSampleFormat pfmt = av_get_planar_sample_fmt(fmt);
+    return pfmt == AV_SAMPLE_FMT_FLTP || pfmt == AV_SAMPLE_FMT_DBLP;
+  }
+
+  /**
+   * \brief Discard the buffered samples (e.g., after seeking)
+   */
+  void reset()
+  {
+    head = tail = 0;
+    primed = false;
+  }
+
+  /**
+   * \brief Append the samples of a frame
+   *
+   * \param[in] frame         Decoded audio frame
+   * \param[in] sample_offset Index of the first sample of the frame in the
+   *                          stream (used to position the windows after a
+   *                          reset)
+   */
+  void push(const AVFrame *frame, const int64_t sample_offset)
+  {
+    if (fmt == AV_SAMPLE_FMT_NONE)
+    {
+      fmt = (AVSampleFormat)frame->format;
+      nch = frame->channels;
+      elsz = av_get_bytes_per_sample(fmt);
+      if (!window.empty() && !weightable(fmt))
+        throw ffmpeg::Exception(
+            "Window function requires floating-point audio samples.");
+    }
+    else if (av_get_planar_sample_fmt((AVSampleFormat)frame->format) !=
+                 av_get_planar_sample_fmt(fmt) ||
+             (size_t)frame->channels != nch)
+      throw ffmpeg::Exception(
+          "Audio format changed mid-stream while windowing.");
+
+    if (!primed)
+    {
+      offset = sample_offset;
+      primed = true;
+    }
+
+    // the packed/planar layout may differ from the first frame's
+    reserve(frame->nb_samples);
+    ffmpeg::audioCopyToColumns(buf.data() + tail * elsz, ld, frame->data, 0,
+                               frame->nb_samples, nch,
+                               (AVSampleFormat)frame->format);
+    tail += frame->nb_samples;
+  }
+
+  /**
+   * \brief Number of complete windows available
+   */
+  size_t size() const
+  {
+    size_t n = tail - head;
+    return n < nwin ? 0 : (n - nwin) / hop + 1;
+  }
+
+  /**
+   * \brief Number of windows to flush at the end of the stream: all the
+   *        complete windows plus a zero-padded one if any sample is left
+   *        uncovered
+   */
+  size_t size_at_eof() const
+  {
+    size_t n = tail - head;
+    size_t K = size();
+    bool uncovered = K ? n > (K - 1) * hop + nwin && n > K * hop : n > 0;
+    return uncovered ? K + 1 : K;
+  }
+
+  /**
+   * \brief Index of the first sample of the next window in the stream
+   */
+  int64_t sample_offset() const { return offset; }
+
+  size_t channels() const { return nch; }
+  AVSampleFormat format() const { return fmt; }
+  size_t window_length() const { return nwin; }
+
+  /**
+   * \brief Copy K windows to dst and drop the samples no longer needed
+   *
+   * \param[out] dst  Nwin x Nch x K column-major block
+   * \param[in]  K    Number of windows (at most size_at_eof(); windows
+   *                  reaching past the buffered samples are zero-padded)
+   */
+  void pop(uint8_t *dst, const size_t K)
+  {
+    const size_t col = nwin * elsz;
+    for (size_t k = 0; k < K; ++k)
+    {
+      size_t start = head + k * hop;
+      size_t n = std::min(nwin, tail > start ? tail - start : 0);
+      for (size_t c = 0; c < nch; ++c)
+      {
+        uint8_t *out = dst + (k * nch + c) * col;
+        if (n) std::memcpy(out, buf.data() + (c * ld + start) * elsz, n * elsz);
+        std::memset(out + n * elsz, 0, col - n * elsz);
+        if (window.size())
+        {
+          if (av_get_planar_sample_fmt(fmt) == AV_SAMPLE_FMT_FLTP)
+            weigh((float *)out);
+          else
+            weigh((double *)out);
+        }
+      }
+    }
+
+    size_t n = std::min(K * hop, tail - head);
+    head += n;
+    offset += n;
+  }
+
+  private:
+  template <typename T> void weigh(T *x) const
+  {
+    for (size_t i = 0; i < nwin; ++i) x[i] = (T)(x[i] * window[i]);
+  }
+
+  // make room for n more samples per channel
+  void reserve(const size_t n)
+  {
+    if (tail + n <= ld) return;
+
+    // move the unconsumed samples to the front, growing the columns if needed
+    size_t nkeep = tail - head;
+    if (nkeep + n > ld)
+    {
+      size_t new_ld = std::max(nkeep + n, 2 * ld);
+      std::vector<uint8_t> dst(new_ld * nch * elsz);
+      for (size_t c = 0; nkeep && c < nch; ++c)
+        std::memcpy(dst.data() + c * new_ld * elsz,
+                    buf.data() + (c * ld + head) * elsz, nkeep * elsz);
+      buf = std::move(dst);
+      ld = new_ld;
+    }
+    else
+    {
+      for (size_t c = 0; nkeep && c < nch; ++c)
+        std::memmove(buf.data() + c * ld * elsz,
+                     buf.data() + (c * ld + head) * elsz, nkeep * elsz);
+    }
+    head = 0;
+    tail = nkeep;
+  }
+
+  size_t nwin;                // window length in samples
+  size_t hop;                 // hop length in samples
+  std::vector<double> window; // window weights (empty: rectangular)
+
+  AVSampleFormat fmt; // sample format (set by the first frame)
+  size_t nch;         // number of channels
+  size_t elsz;        // bytes per sample
+
+  std::vector<uint8_t> buf; // nch columns of ld samples
+  size_t ld;                // column length in samples
+  size_t head;              // first unconsumed sample in each column
+  size_t tail;              // one past the last buffered sample
+  int64_t offset;           // stream index of the sample at head
+  bool primed;              // true once offset is set
+};
@@ -12,11 +12,20 @@ function varargout = read(obj, varargin)
 %   For example, given a file that contains 8-bit unsigned values 
 %   corresponding to three color bands (RGB24), video is an array of 
 %   uint8 values.
+%   RGB and grayscale frames are returned as uint16 or single arrays if
+%   so specified by the VideoDataType property.
+%   If the VideoFormat property is 'planes', VIDEO is a struct with a field
+%   per component plane (Y, U, V for YUV video), each at its native
+%   resolution (chroma not resampled) and of uint8 or uint16 class.
 %
 %   VIDEO = READ(OBJ,INDEX) reads only the specified frames. INDEX can be 
 %   a single number or a two-element array representing an INDEX range 
 %   of the video stream.  Use Inf to represent the last frame of the file.
 %
+%   [VIDEO,TS] = READ(OBJ,...) also returns the presentation timestamps of
+%   the returned frames in TS, a struct with fields Stream, Time (seconds),
+%   and Pts (raw int64 timestamps in the stream time base).
+%
 %   For example:
 %
 %      VIDEO = READ(OBJ, 1);        % first frame only
@@ -94,7 +103,12 @@ function varargout = read(obj, varargin)
 %
 %   See also AUDIOVIDEO, MOVIE, VIDEOREADER, VIDEOREADER/READFRAME, VIDEOREADER/HASFRAME, MMFILEINFO.
 
-[varargout{1:nargout}] = obj.mex_backend(obj.backend,'read',varargin{:});
+narginchk(1,3);
+if nargin>1 && ~ischar(varargin{1})
+   validateattributes(varargin{1},{'numeric'},{'vector','positive','nonnan'},mfilename,'INDEX');
+   varargin{1} = double(varargin{1});
+end
+[varargout{1:nargout}] = obj.mex_backend(obj,'read',varargin{:});
 
 % if length(obj) > 1
 %     error(message('ffmpeg:Reader:nonscalar'));
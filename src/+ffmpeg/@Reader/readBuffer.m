@@ -11,6 +11,27 @@ function varargout = readBuffer(obj)
 %   corresponding to three color bands (RGB24), video is an array of 
 %   uint8 values.
 %
+%   [V1,V2,...,TS] = READBUFFER(OBJ) also returns the presentation timestamps of
+%   the returned frames in TS if requested with one more output than the
+%   number of active streams. TS is a struct array with an element per
+%   stream and fields:
+%         Stream  the stream specifier
+%         Time    column vector of the frame timestamps in seconds
+%         Pts     column vector of the raw timestamps (int64) in the stream
+%                 time base
+%         SampleOffset  (audio) 0-based index of the first returned
+%                 sample in the stream ([] for video)
+%
+%   Audio frames are returned as an Nmax x Nch x Nframes array, each frame
+%   zero-padded to the longest, or, if the AudioLayout property is
+%   'contiguous', as a single Nsamples x Nch array of consecutive samples.
+%   If the WindowLength property is nonzero, audio is instead returned as
+%   an Nwin x Nch x K array of the K overlapping windows (HopLength samples
+%   apart) completed by the call; the samples of an incomplete window are
+%   held over to the next call, and the last window is zero-padded at the
+%   end of the stream. SampleOffset is then the first sample of the first
+%   window while Time and Pts still list the decoded frames.
+%
 %   VIDEO = READ(OBJ,'native') always returns data in the format specified 
 %   by the VideoFormat property, and can include any of the input arguments
 %   in previous syntaxes.  See 'Output Formats' section below.
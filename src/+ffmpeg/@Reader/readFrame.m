@@ -10,6 +10,32 @@ function varargout = readFrame(obj, varargin)
 %   For example, given a file that contains 8-bit unsigned values 
 %   corresponding to three color bands (RGB24), video is an array of 
 %   uint8 values.
+%   RGB and grayscale frames are returned as uint16 or single arrays if
+%   so specified by the VideoDataType property.
+%   If the VideoFormat property is 'planes', VIDEO is a struct with a field
+%   per component plane (Y, U, V for YUV video), each at its native
+%   resolution (chroma not resampled) and of uint8 or uint16 class.
+%
+%   [V1,V2,...,TS] = READFRAME(OBJ) also returns the presentation timestamps of
+%   the returned frames in TS if requested with one more output than the
+%   number of active streams. TS is a struct array with an element per
+%   stream and fields:
+%         Stream  the stream specifier
+%         Time    column vector of the frame timestamps in seconds
+%         Pts     column vector of the raw timestamps (int64) in the stream
+%                 time base
+%         SampleOffset  (audio) 0-based index of the first returned
+%                 sample in the stream ([] for video)
+%
+%   Audio frames are returned as an Nmax x Nch x Nframes array, each frame
+%   zero-padded to the longest, or, if the AudioLayout property is
+%   'contiguous', as a single Nsamples x Nch array of consecutive samples.
+%   If the WindowLength property is nonzero, audio is instead returned as
+%   an Nwin x Nch x K array of the K overlapping windows (HopLength samples
+%   apart) completed by the call; the samples of an incomplete window are
+%   held over to the next call, and the last window is zero-padded at the
+%   end of the stream. SampleOffset is then the first sample of the first
+%   window while Time and Pts still list the decoded frames.
 %
 %   VIDEO = READ(OBJ,'native') always returns data in the format specified 
 %   by the VideoFormat property, and can include any of the input arguments
@@ -4,6 +4,9 @@
 
 #include <ffmpegPtrs.h>
 #include <ffmpegTimeUtil.h>
+#include "../utils/ffmpegAudioUtils.h"
+#include "../utils/ffmpegPacketIndex.h"
+#include "../utils/mexGrowableBuffer.h"
 #include "../utils/mxutils.h"
 #include "@Reader/mexReaderPostOps.h"
 
@@ -15,6 +18,13 @@ extern "C"
 }
 
 #include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <thread>
+#include <vector>
 
 #include <chrono>
 typedef std::chrono::duration<double> mex_duration_t;
@@ -25,6 +35,8 @@ bool log_uninit = true;
 // [Y, FS]=audioread(FILENAME, [START END])
 // [Y, FS]=audioread(FILENAME, DATATYPE)
 // [Y, FS]=audioread(FILENAME, [START END], DATATYPE);
+// [Y, FS]=audioread(..., 'Threads', K);
+// [Y, FS]=audioread(..., 'Prepass', TF);
 
 struct InputArgs
 {
@@ -33,32 +45,41 @@ struct InputArgs
   size_t end;
   AVSampleFormat format;
   mxClassID class_id;
+  size_t nthreads; // number of decoding threads (0: auto)
+  bool prepass;    // true to estimate the samples by a demux pass beforehand
 
   InputArgs(int nrhs, const mxArray *prhs[]);
 };
 
-void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
-{
-  // initialize ffmpeg::Exception
-  if (log_uninit)
-  {
-    ffmpeg::Exception::initialize();
-    // ffmpeg::Exception::log_fcn = [](const auto &msg) {
-    //   mexPrintf("%s\n", msg.c_str());
-    // };
-    log_uninit = false;
-  }
+typedef ffmpeg::Reader<ffmpeg::AVFrameQueueST> AudioReader;
 
-  if (nlhs > 2 || nrhs < 1 || nrhs > 3)
-    mexErrMsgIdAndTxt("ffmpeg.audioinfo:invalidNumberOfArguments",
-                      "Invalid number of input or output arguments specified.");
+// decoding starts this far ahead of the first requested sample so the decoder
+// is primed (e.g., the AAC/MP3 overlap) once the first sample is reached
+static const double preroll = 0.25; // seconds
 
-  // parse the input arguments
-  InputArgs args(nrhs, prhs);
+// shortest range a parallel segment is given (as each opens its own reader)
+static const double min_segment_duration = 5.0; // seconds
 
-  // open the audio file
-  ffmpeg::Reader<ffmpeg::AVFrameQueueST> reader;
-  reader.openFile(args.url);
+enum ReadStatus
+{
+  READ_OK,
+  READ_NO_DATA,
+  READ_BAD_OFFSET
+};
+
+/**
+ * \brief Open url & activate its first audio stream
+ *
+ * \param[in]    reader Reader to open
+ * \param[in]    url    Media file
+ * \param[inout] format Packed output sample format (AV_SAMPLE_FMT_NONE to use
+ *                      the native format, returned)
+ * \returns the stream id
+ */
+static int open_audio(AudioReader &reader, const std::string &url,
+                      AVSampleFormat &format)
+{
+  reader.openFile(url);
 
   // add audio stream (throws InvalidStreamSpecifier if no audio stream found)
   int stream_id = reader.addStream(AVMEDIA_TYPE_AUDIO);
@@ -68,26 +89,31 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
   // activate the reader
   reader.activate();
 
-  // set postop filter if needed
-  AVSampleFormat format = stream.getFormat();
-  if (args.format == AV_SAMPLE_FMT_NONE)
-  {
-    args.format = av_get_packed_sample_fmt(format);
-    switch (args.format)
-    {
-    case AV_SAMPLE_FMT_U8: args.class_id = mxUINT8_CLASS; break;
-    case AV_SAMPLE_FMT_S16: args.class_id = mxINT16_CLASS; break;
-    case AV_SAMPLE_FMT_S32: args.class_id = mxINT32_CLASS; break;
-    case AV_SAMPLE_FMT_S64: args.class_id = mxINT64_CLASS; break;
-    case AV_SAMPLE_FMT_FLT: args.class_id = mxSINGLE_CLASS; break;
-    default: args.class_id = mxDOUBLE_CLASS;
-    }
-  }
-  if (args.format != format)
-  {
-    format = args.format;
-    reader.setPostOp<mexFFmpegAudioPostOp>(stream_id, format);
-  }
+  // set postop filter if needed: planar & packed frames are both written
+  // straight to the output columns, so only a sample type change calls for
+  // the post-op
+  AVSampleFormat native = av_get_packed_sample_fmt(stream.getFormat());
+  if (format == AV_SAMPLE_FMT_NONE) format = native;
+  if (native != format)
+    reader.setPostOp<mexFFmpegAudioPostOp>(stream_id,
+                                           av_get_planar_sample_fmt(format));
+
+  return stream_id;
+}
+
+/**
+ * \brief Decode n samples of the audio stream from the 0-based sample index
+ *        start (n = SIZE_MAX: to the end of the stream)
+ *
+ * Each run of decoded samples is passed on to copy(frame, count, offset),
+ * the count samples of frame from its sample offset.
+ */
+template <typename CopyFcn>
+static ReadStatus read_samples(AudioReader &reader, const int stream_id,
+                               const uint64_t start, size_t n, CopyFcn copy)
+{
+  ffmpeg::InputAudioStream &stream =
+      dynamic_cast<ffmpeg::InputAudioStream &>(reader.getStream(stream_id));
 
   // analyze time-base & sample rate
   int fs = stream.getSampleRate();
@@ -100,60 +126,13 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
                                          tb2Period.num, tb2Period.den);
   };
 
-  // set start & end 0-based sample indices
-  uint64_t start(0), end(0);
-  bool toEOF(!args.end);
-  if (args.start) { start = args.start - 1; }
-  if (toEOF)
-    end = stream.getTotalNumberOfSamples();
-  else
-    end = args.end;
-
-  // get estimated number of samples to be read
-  size_t N = end - start;
-  size_t Nch = stream.getChannels();
-
-  mxArray *Yt = mxCreateNumericMatrix(Nch, N, args.class_id, mxREAL);
-  uint8_t *data = (uint8_t *)mxGetData(Yt);
-  size_t elsz = mxGetElementSize(Yt);
-
-  size_t n_left = N; // bytes left in the buffer
-  uint8_t *dst[AV_NUM_DATA_POINTERS];
-  dst[0] = data;
-  dst[1] = nullptr;
-
-  // number of bytes/sample
-  size_t nbuf = elsz * Nch;
-
   AVFrame *frame = av_frame_alloc();
   ffmpeg::AVFramePtr frame_cleanup(frame, ffmpeg::delete_av_frame);
 
-  auto copy_data = [&dst, &n_left, &Yt, nbuf, format](const AVFrame *frame,
-                                                      int n, int offset = 0) {
-    if (n_left < n)
-    {
-      // if run out of space, expand the mxArray
-      uint8_t *data = (uint8_t *)mxGetData(Yt);
-      size_t elsz = mxGetElementSize(Yt);
-      size_t dst_offset = dst[0] - data;
-      size_t N = mxGetN(Yt) + (n - n_left);
-      data = (uint8_t *)mxRealloc(data, N * frame->channels * elsz);
-      mxSetData(Yt, data);
-      mxSetN(Yt, N);
-      dst[0] = data + dst_offset;
-      n_left = 0;
-    }
-    else
-    {
-      n_left -= n;
-    }
-    av_samples_copy(dst, frame->data, 0, offset, n, frame->channels, format);
-
-    dst[0] += nbuf * n;
-  };
-
-  // seek to near the starting frame
-  reader.seek(mex_duration_t(start / (double)fs), false);
+  // seek to near the starting frame, ahead by the pre-roll
+  mex_duration_t t0(start / (double)fs);
+  reader.seek(std::max(t0 - mex_duration_t(preroll), mex_duration_t(0.0)),
+              false);
 
   // get the first frame
   reader.readNextFrame(frame, stream_id);
@@ -161,7 +140,6 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
   {
     // get frames until reader's next frame is past the starting time while
     // the last read frame contains the requested start time
-    mex_duration_t t0(start / (double)fs);
     while (!reader.atEndOfStream(stream_id) &&
            reader.getTimeStamp<mex_duration_t>(stream_id) < t0)
     {
@@ -171,32 +149,233 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
   }
 
   // no data (shouldn't happen)
-  if (frame->nb_samples == 0)
-    mexErrMsgIdAndTxt("ffmpeg:audioread:NoData", "No data found.");
+  if (frame->nb_samples == 0) return READ_NO_DATA;
 
   // copy the data from the first frame
-  int offset = (int)(start - get_frame_time(frame));
-  if (offset < 0)
-    mexErrMsgIdAndTxt("ffmpeg:audioread:BadOffset", "Seek failed.");
-
-  int n = frame->nb_samples - offset;
-  copy_data(frame, (toEOF || n < n_left) ? n : (int)n_left, offset);
+  int64_t offset = (int64_t)start - get_frame_time(frame);
+  if (offset < 0) return READ_BAD_OFFSET;
+  if (offset < frame->nb_samples)
+  {
+    size_t count = std::min((size_t)(frame->nb_samples - offset), n);
+    copy(frame, count, (int)offset);
+    n -= count;
+  }
 
   // work the remaining frames
-  while (!reader.atEndOfStream(stream_id) && (toEOF || n_left > 0))
+  while (n && !reader.atEndOfStream(stream_id))
   {
     reader.readNextFrame(frame, stream_id);
-    n = frame->nb_samples;
-    if (!toEOF && n > n_left) n = (int)n_left;
-    copy_data(frame, n);
+    size_t count = std::min((size_t)frame->nb_samples, n);
+    copy(frame, count, 0);
+    n -= count;
+  }
+
+  return READ_OK;
+}
+
+static void check_status(const ReadStatus status)
+{
+  if (status == READ_NO_DATA)
+    mexErrMsgIdAndTxt("ffmpeg:audioread:NoData", "No data found.");
+  else if (status == READ_BAD_OFFSET)
+    mexErrMsgIdAndTxt("ffmpeg:audioread:BadOffset", "Seek failed.");
+}
+
+/**
+ * \brief Estimate the number of samples of the audio stream by a demux-only
+ *        pass (no decoding) over the file
+ *
+ * The stream duration is measured from its first packet (not the file start
+ * time), and its n packets are taken to be of the mean duration of the first
+ * n-1. Encoder priming & padding are not accounted for, so the output buffer
+ * may still be grown or trimmed.
+ */
+static uint64_t estimate_samples(const std::string &url, const int stream_id,
+                                 const int fs)
+{
+  ffmpeg::PacketIndex index;
+  index.build(url);
+  size_t n = index.getNumberOfFrames(stream_id);
+  if (n < 2) return 0;
+  double t0 = index.getFrameTime(stream_id, 0);
+  double t1 = index.getFrameTime(stream_id, n - 1);
+  return (uint64_t)std::llround((t1 - t0) * n / (n - 1) * fs);
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+  // initialize ffmpeg::Exception
+  if (log_uninit)
+  {
+    ffmpeg::Exception::initialize();
+    // ffmpeg::Exception::log_fcn = [](const auto &msg) {
+    //   mexPrintf("%s\n", msg.c_str());
+    // };
+    log_uninit = false;
+  }
+
+  if (nlhs > 2 || nrhs < 1 || nrhs > 7)
+    mexErrMsgIdAndTxt("ffmpeg.audioinfo:invalidNumberOfArguments",
+                      "Invalid number of input or output arguments specified.");
+
+  // parse the input arguments
+  InputArgs args(nrhs, prhs);
+
+  // open the audio file
+  AudioReader reader;
+  int stream_id = open_audio(reader, args.url, args.format);
+  ffmpeg::InputAudioStream &stream =
+      dynamic_cast<ffmpeg::InputAudioStream &>(reader.getStream(stream_id));
+
+  switch (args.format)
+  {
+  case AV_SAMPLE_FMT_U8: args.class_id = mxUINT8_CLASS; break;
+  case AV_SAMPLE_FMT_S16: args.class_id = mxINT16_CLASS; break;
+  case AV_SAMPLE_FMT_S32: args.class_id = mxINT32_CLASS; break;
+  case AV_SAMPLE_FMT_S64: args.class_id = mxINT64_CLASS; break;
+  case AV_SAMPLE_FMT_FLT: args.class_id = mxSINGLE_CLASS; break;
+  default: args.class_id = mxDOUBLE_CLASS;
+  }
+
+  int fs = stream.getSampleRate();
+
+  // set start & end 0-based sample indices
+  uint64_t start(0), end(0);
+  bool toEOF(!args.end);
+  if (args.start) { start = args.start - 1; }
+  if (toEOF)
+  {
+    // estimate by the packet pre-pass if requested, else by the stream
+    if (args.prepass) end = estimate_samples(args.url, stream_id, fs);
+    if (!end) end = stream.getTotalNumberOfSamples();
   }
+  else
+    end = args.end;
 
-  // call MATLAB transpose function to finalize combined-audio output
-  mxArray *Y;
-  mexCallMATLAB(1, &Y, 1, &Yt, "transpose");
-  mxDestroyArray(Yt);
+  // get estimated number of samples to be read
+  size_t N = end > start ? end - start : 0;
+  size_t Nch = stream.getChannels();
 
-  plhs[0] = Y;
+  // samples are written directly in the final N-by-Nch column-major layout,
+  // growing past the estimate if it falls short
+  size_t elsz = av_get_bytes_per_sample(args.format);
+  mexGrowableBuffer Y(elsz, Nch, N);
+
+  // split the range into K segments, each decoded by its own reader
+  size_t K = args.nthreads ? args.nthreads
+                           : std::max(std::thread::hardware_concurrency(), 1u);
+  K = std::min(K, std::max(N / (size_t)(min_segment_duration * fs),
+                           (size_t)1));
+
+  if (K == 1)
+  {
+    auto copy_data = [&Y](const AVFrame *frame, size_t n, int offset) {
+      uint8_t *dst = Y.append(n);
+      ffmpeg::audioCopyToColumns(dst, Y.capacity(), frame->data, offset,
+                                 (int)n, frame->channels,
+                                 (AVSampleFormat)frame->format);
+    };
+
+    check_status(read_samples(reader, stream_id, start,
+                              toEOF ? SIZE_MAX : N, copy_data));
+  }
+  else
+  {
+    // segment k covers [bounds[k], bounds[k+1]) of the output rows and is
+    // written straight into its slice of Y (which does not move until all
+    // are joined). The last one runs to the end of the stream if toEOF,
+    // holding on to the frames that overflow Y.
+    struct Overflow
+    {
+      ffmpeg::AVFramePtr frame;
+      size_t count;
+      int offset;
+    };
+    std::vector<size_t> bounds(K + 1);
+    for (size_t k = 0; k <= K; ++k) bounds[k] = k * N / K;
+    std::vector<size_t> nread(K, 0);
+    std::vector<ReadStatus> status(K, READ_OK);
+    std::vector<std::exception_ptr> errors(K);
+    std::vector<Overflow> overflow;
+
+    uint8_t *data = Y.append(N); // filled by the segments
+    auto read_segment = [&](AudioReader &reader, const int stream_id,
+                            const size_t k) {
+      size_t cap = bounds[k + 1] - bounds[k];
+      size_t n = toEOF && k == K - 1 ? SIZE_MAX : cap;
+      auto copy = [&, k, cap](const AVFrame *frame, size_t count, int offset) {
+        size_t m = std::min(count, cap - std::min(nread[k], cap));
+        if (m)
+          ffmpeg::audioCopyToColumns(data + (bounds[k] + nread[k]) * elsz, N,
+                                     frame->data, offset, m, frame->channels,
+                                     (AVSampleFormat)frame->format);
+        if (m < count)
+          overflow.push_back({ffmpeg::AVFramePtr(av_frame_clone(frame),
+                                                 ffmpeg::delete_av_frame),
+                              count - m, offset + (int)m});
+        nread[k] += count;
+      };
+      try
+      {
+        status[k] = read_samples(reader, stream_id, start + bounds[k], n, copy);
+      }
+      catch (...)
+      {
+        errors[k] = std::current_exception();
+      }
+    };
+
+    // the first segment is decoded on this thread with the opened reader
+    std::vector<std::thread> workers;
+    for (size_t k = 1; k < K; ++k)
+      workers.emplace_back([&, k]() {
+        try
+        {
+          AudioReader reader;
+          AVSampleFormat format = args.format;
+          int stream_id = open_audio(reader, args.url, format);
+          read_segment(reader, stream_id, k);
+        }
+        catch (...)
+        {
+          errors[k] = std::current_exception();
+        }
+      });
+    read_segment(reader, stream_id, 0);
+    for (auto &worker : workers) worker.join();
+
+    // stitch the segments: a short one means the stream ended in it, so the
+    // following segments have nothing to offer
+    size_t pos = 0;
+    for (size_t k = 0; k < K; ++k)
+    {
+      if (errors[k]) std::rethrow_exception(errors[k]);
+      if (k && status[k] == READ_NO_DATA) break; // ended on the boundary
+      check_status(status[k]);
+      pos = bounds[k] + nread[k];
+      if (nread[k] < bounds[k + 1] - bounds[k]) break;
+    }
+
+    // append the samples past the estimated length
+    Y.resize(std::min(pos, N));
+    if (pos > N)
+      for (auto &o : overflow)
+        ffmpeg::audioCopyToColumns(Y.append(o.count), Y.capacity(),
+                                   o.frame->data, o.offset, (int)o.count,
+                                   o.frame->channels,
+                                   (AVSampleFormat)o.frame->format);
+  }
+
+  // a range past the end of the stream is zero-padded, but a read to the end
+  // is trimmed to the samples actually read
+  if (!toEOF) Y.resize(N);
+  size_t M = Y.size();
+  plhs[0] = mxCreateNumericMatrix(0, Nch, args.class_id, mxREAL);
+  if (M)
+  {
+    mxSetData(plhs[0], Y.release());
+    mxSetM(plhs[0], M);
+  }
   if (nlhs > 1) plhs[1] = mxCreateDoubleScalar(fs);
 }
 
@@ -204,9 +383,43 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 // [Y, FS]=audioread(FILENAME, [START END])
 // [Y, FS]=audioread(FILENAME, DATATYPE)
 // [Y, FS]=audioread(FILENAME, [START END], DATATYPE);
+// [Y, FS]=audioread(..., 'Threads', K);
+// [Y, FS]=audioread(..., 'Prepass', TF);
 InputArgs::InputArgs(int nrhs, const mxArray *prhs[])
-    : start(0), end(0), format(AV_SAMPLE_FMT_DBL), class_id(mxDOUBLE_CLASS)
+    : start(0), end(0), format(AV_SAMPLE_FMT_DBL), class_id(mxDOUBLE_CLASS),
+      nthreads(1), prepass(false)
 {
+  // trailing 'Threads' & 'Prepass' options
+  while (nrhs > 2 && mxIsChar(prhs[nrhs - 2]))
+  {
+    std::string name = mexGetString(prhs[nrhs - 2]);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    const mxArray *mxValue = prhs[nrhs - 1];
+    if (name == "threads")
+    {
+      if (!(mxIsNumeric(mxValue) && mxGetNumberOfElements(mxValue) == 1) ||
+          mxGetScalar(mxValue) < 0 ||
+          mxGetScalar(mxValue) != (size_t)mxGetScalar(mxValue))
+        mexErrMsgIdAndTxt("ffmpeg:audioread:InvalidInputArguments",
+                          "Threads must be a nonnegative integer scalar.");
+      nthreads = (size_t)mxGetScalar(mxValue);
+    }
+    else if (name == "prepass")
+    {
+      if (!((mxIsNumeric(mxValue) || mxIsLogical(mxValue)) &&
+            mxGetNumberOfElements(mxValue) == 1))
+        mexErrMsgIdAndTxt("ffmpeg:audioread:InvalidInputArguments",
+                          "Prepass must be a logical scalar.");
+      prepass = mxGetScalar(mxValue) != 0.0;
+    }
+    else
+      break;
+    nrhs -= 2;
+  }
+  if (nrhs > 3)
+    mexErrMsgIdAndTxt("ffmpeg.audioinfo:invalidNumberOfArguments",
+                      "Invalid number of input or output arguments specified.");
+
   mxArray *mxURL;
   mexCallMATLAB(1, &mxURL, 1, (mxArray **)prhs, "which");
   url = mexGetString(mxURL);
@@ -17,6 +17,19 @@ function [y, Fs] = audioread(filename, range, datatype)
 %
 %   [Y, FS] = ffmpeg.AUDIOREAD(FILENAME, [START END], DATATYPE);
 %
+%   [Y, FS] = ffmpeg.AUDIOREAD(..., 'Threads', K) decodes the samples in K
+%   parallel time segments (K = 0: one per CPU core), each with its own
+%   decoder writing directly into its part of Y. Segments are kept at least
+%   5 seconds long, so short reads stay single-threaded. The default is 1.
+%
+%   [Y, FS] = ffmpeg.AUDIOREAD(..., 'Prepass', true) estimates the number
+%   of samples by a quick pass over the file packets (no decoding) before
+%   reading to the end of the file, so Y is allocated close to its final
+%   size even if the file reports a wrong duration. The estimate assumes
+%   packets of equal duration and ignores encoder priming and padding; Y is
+%   still grown or trimmed to the samples actually decoded. Without it, Y
+%   grows as needed.
+%
 %   Output Data Ranges Y is returned as an m-by-n matrix, where m is the
 %   number of audio samples read and n is the number of audio channels in
 %   the file.
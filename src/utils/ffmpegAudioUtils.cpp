@@ -0,0 +1,194 @@
+#include "ffmpegAudioUtils.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                  \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FFMPEG_AUDIO_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define FFMPEG_AUDIO_NEON
+#include <arm_neon.h>
+#endif
+
+#include "ffmpegException.h"
+
+using namespace ffmpeg;
+
+namespace
+{
+
+// number of samples de-interleaved per channel sweep: keeps the interleaved
+// source block in L1 while the channel columns are written one at a time
+constexpr int BLOCK = 1024;
+
+/////////////////////////////////////////////////////////////////////////////
+// stereo de-interleave kernels: return the number of samples processed, the
+// caller finishes the tail
+
+template <typename T>
+int stereo_simd(T *, T *, const T *, const int)
+{
+  return 0;
+}
+
+#if defined(FFMPEG_AUDIO_SSE2)
+
+template <>
+int stereo_simd<int16_t>(int16_t *l, int16_t *r, const int16_t *s,
+                         const int n)
+{
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m128i a = _mm_loadu_si128((const __m128i *)(s + 2 * i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(s + 2 * i + 8));
+    // sign-extend the even (left) and odd (right) 16-bit lanes to 32 bits
+    // and pack them back: the values are in range so packs is exact
+    __m128i al = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+    __m128i bl = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+    _mm_storeu_si128((__m128i *)(l + i), _mm_packs_epi32(al, bl));
+    _mm_storeu_si128((__m128i *)(r + i),
+                     _mm_packs_epi32(_mm_srai_epi32(a, 16),
+                                     _mm_srai_epi32(b, 16)));
+  }
+  return i;
+}
+
+template <>
+int stereo_simd<int32_t>(int32_t *l, int32_t *r, const int32_t *s,
+                         const int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128 a = _mm_loadu_ps((const float *)(s + 2 * i));
+    __m128 b = _mm_loadu_ps((const float *)(s + 2 * i + 4));
+    _mm_storeu_ps((float *)(l + i), _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_ps((float *)(r + i), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+  }
+  return i;
+}
+
+template <>
+int stereo_simd<int64_t>(int64_t *l, int64_t *r, const int64_t *s,
+                         const int n)
+{
+  int i = 0;
+  for (; i + 2 <= n; i += 2)
+  {
+    __m128d a = _mm_loadu_pd((const double *)(s + 2 * i));
+    __m128d b = _mm_loadu_pd((const double *)(s + 2 * i + 2));
+    _mm_storeu_pd((double *)(l + i), _mm_unpacklo_pd(a, b));
+    _mm_storeu_pd((double *)(r + i), _mm_unpackhi_pd(a, b));
+  }
+  return i;
+}
+
+#elif defined(FFMPEG_AUDIO_NEON)
+
+template <>
+int stereo_simd<int16_t>(int16_t *l, int16_t *r, const int16_t *s,
+                         const int n)
+{
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    int16x8x2_t v = vld2q_s16(s + 2 * i);
+    vst1q_s16(l + i, v.val[0]);
+    vst1q_s16(r + i, v.val[1]);
+  }
+  return i;
+}
+
+template <>
+int stereo_simd<int32_t>(int32_t *l, int32_t *r, const int32_t *s,
+                         const int n)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    int32x4x2_t v = vld2q_s32(s + 2 * i);
+    vst1q_s32(l + i, v.val[0]);
+    vst1q_s32(r + i, v.val[1]);
+  }
+  return i;
+}
+
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+
+// T is only used as a sample container of the right size: float/double
+// samples are moved as int32_t/int64_t bit patterns
+template <typename T>
+void deinterleave(uint8_t *dst_, const size_t ld, const uint8_t *src_,
+                  const int n, const int nch)
+{
+  T *dst = (T *)dst_;
+  const T *src = (const T *)src_;
+
+  if (nch == 2)
+  {
+    T *l = dst, *r = dst + ld;
+    int i = stereo_simd<T>(l, r, src, n);
+    for (; i < n; ++i)
+    {
+      l[i] = src[2 * i];
+      r[i] = src[2 * i + 1];
+    }
+    return;
+  }
+
+  for (int i0 = 0; i0 < n; i0 += BLOCK)
+  {
+    const int i1 = std::min(n, i0 + BLOCK);
+    for (int c = 0; c < nch; ++c)
+    {
+      T *d = dst + c * ld;
+      const T *s = src + c;
+      for (int i = i0; i < i1; ++i) d[i] = s[(size_t)i * nch];
+    }
+  }
+}
+
+} // namespace
+
+void ffmpeg::audioCopyToColumns(uint8_t *dst, const size_t ld,
+                                const uint8_t *const *src,
+                                const int src_offset, const int nb_samples,
+                                const int nb_channels,
+                                const AVSampleFormat fmt)
+{
+  const int elsz = av_get_bytes_per_sample(fmt);
+  if (!elsz) throw Exception("Invalid audio sample format.");
+  if (nb_samples <= 0 || nb_channels <= 0) return;
+
+  const size_t col_size = ld * elsz;
+  const size_t nbytes = (size_t)nb_samples * elsz;
+
+  if (av_sample_fmt_is_planar(fmt))
+  {
+    const size_t offset = (size_t)src_offset * elsz;
+    for (int c = 0; c < nb_channels; ++c)
+      std::memcpy(dst + c * col_size, src[c] + offset, nbytes);
+    return;
+  }
+
+  const uint8_t *s = src[0] + (size_t)src_offset * nb_channels * elsz;
+  if (nb_channels == 1)
+  {
+    std::memcpy(dst, s, nbytes);
+    return;
+  }
+
+  switch (elsz)
+  {
+  case 1: deinterleave<uint8_t>(dst, ld, s, nb_samples, nb_channels); break;
+  case 2: deinterleave<int16_t>(dst, ld, s, nb_samples, nb_channels); break;
+  case 4: deinterleave<int32_t>(dst, ld, s, nb_samples, nb_channels); break;
+  case 8: deinterleave<int64_t>(dst, ld, s, nb_samples, nb_channels); break;
+  default: throw Exception("Unsupported audio sample size.");
+  }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+extern "C"
+{
+#include <libavutil/samplefmt.h>
+}
+
+namespace ffmpeg
+{
+
+/**
+ * \brief Copy audio samples into a column-major (MATLAB) buffer
+ *
+ * audioCopyToColumns() writes each channel of the source samples into its
+ * own column of dst so that the result is already in MATLAB's
+ * samples-by-channels layout. Planar data is copied channel by channel while
+ * packed (interleaved) data is de-interleaved (SIMD-accelerated for stereo
+ * 16/32/64-bit samples).
+ *
+ * @param[out] dst         destination of the first sample of the first
+ *                         channel
+ * @param[in]  ld          column length (leading dimension) of dst in
+ *                         samples
+ * @param[in]  src         source data pointers (AVFrame::data or equivalent)
+ * @param[in]  src_offset  index of the first source sample to copy
+ * @param[in]  nb_samples  number of samples per channel to copy
+ * @param[in]  nb_channels number of channels
+ * @param[in]  fmt         sample format of src (dst has the same sample type)
+ */
+void audioCopyToColumns(uint8_t *dst, const size_t ld,
+                        const uint8_t *const *src, const int src_offset,
+                        const int nb_samples, const int nb_channels,
+                        const AVSampleFormat fmt);
+
+} // namespace ffmpeg
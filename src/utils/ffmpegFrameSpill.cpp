@@ -0,0 +1,204 @@
+#include "ffmpegFrameSpill.h"
+
+extern "C"
+{
+#include <libavutil/imgutils.h>
+#include <libavutil/samplefmt.h>
+}
+
+#include <algorithm>
+
+#include "ffmpegException.h"
+
+using namespace ffmpeg;
+
+namespace
+{
+
+// fixed-size record preceding the data of each spilled frame
+struct FrameHeader
+{
+  int32_t format;
+  int32_t width; // >0 for video
+  int32_t height;
+  int32_t nb_samples; // >0 for audio
+  int32_t channels;
+  int32_t sample_rate;
+  int32_t key_frame;
+  int32_t colorspace; // video color properties
+  int32_t color_range;
+  int32_t color_primaries;
+  int32_t color_trc;
+  int32_t chroma_location;
+  int32_t sar_num; // sample_aspect_ratio
+  int32_t sar_den;
+  uint64_t channel_layout;
+  int64_t pts;
+  int64_t pkt_dts;
+  int64_t best_effort_timestamp;
+  double t;
+  uint64_t data_size;
+};
+
+int seek(std::FILE *file, const int64_t offset)
+{
+#ifdef _WIN32
+  return _fseeki64(file, offset, SEEK_SET);
+#else
+  return fseeko(file, (off_t)offset, SEEK_SET);
+#endif
+}
+
+} // namespace
+
+void FrameSpill::push(const AVFrame *frame, const double t)
+{
+  if (!file && !(file = std::tmpfile()))
+    throw Exception("Failed to create a temporary file to spill frames.");
+
+  FrameHeader hdr = {frame->format,
+                     frame->width,
+                     frame->height,
+                     frame->nb_samples,
+                     frame->channels,
+                     frame->sample_rate,
+                     frame->key_frame,
+                     frame->colorspace,
+                     frame->color_range,
+                     frame->color_primaries,
+                     frame->color_trc,
+                     frame->chroma_location,
+                     frame->sample_aspect_ratio.num,
+                     frame->sample_aspect_ratio.den,
+                     frame->channel_layout,
+                     frame->pts,
+                     frame->pkt_dts,
+                     frame->best_effort_timestamp,
+                     t,
+                     0};
+
+  if (frame->width > 0) // video: pack the planes without line padding
+  {
+    AVPixelFormat fmt = (AVPixelFormat)frame->format;
+    int size = av_image_get_buffer_size(fmt, frame->width, frame->height, 1);
+    if (size < 0) throw Exception(size);
+    buf.resize(size);
+    av_image_copy_to_buffer(buf.data(), size, frame->data, frame->linesize,
+                            fmt, frame->width, frame->height, 1);
+    hdr.data_size = size;
+  }
+  else // audio: planes are written back-to-back
+  {
+    hdr.data_size = av_samples_get_buffer_size(
+        nullptr, frame->channels, frame->nb_samples,
+        (AVSampleFormat)frame->format, 1);
+  }
+
+  if (seek(file, wpos) || std::fwrite(&hdr, sizeof(hdr), 1, file) != 1)
+    throw Exception("Failed to spill a frame to the temporary file.");
+
+  if (frame->width > 0)
+  {
+    if (std::fwrite(buf.data(), 1, buf.size(), file) != buf.size())
+      throw Exception("Failed to spill a frame to the temporary file.");
+  }
+  else
+  {
+    AVSampleFormat fmt = (AVSampleFormat)frame->format;
+    bool planar = av_sample_fmt_is_planar(fmt);
+    int nplanes = planar ? frame->channels : 1;
+    size_t plane_size = hdr.data_size / nplanes;
+    for (int i = 0; i < nplanes; ++i)
+      if (std::fwrite(frame->extended_data[i], 1, plane_size, file) !=
+          plane_size)
+        throw Exception("Failed to spill a frame to the temporary file.");
+  }
+
+  wpos += sizeof(hdr) + hdr.data_size;
+  ++count;
+}
+
+double FrameSpill::pop(AVFrame *frame)
+{
+  if (!count) throw Exception("No spilled frame to restore.");
+
+  FrameHeader hdr;
+  if (seek(file, rpos) || std::fread(&hdr, sizeof(hdr), 1, file) != 1)
+    throw Exception("Failed to restore a frame from the temporary file.");
+
+  frame->format = hdr.format;
+  frame->width = hdr.width;
+  frame->height = hdr.height;
+  frame->nb_samples = hdr.nb_samples;
+  frame->channels = hdr.channels;
+  frame->channel_layout = hdr.channel_layout;
+  frame->sample_rate = hdr.sample_rate;
+  frame->key_frame = hdr.key_frame;
+  frame->colorspace = (AVColorSpace)hdr.colorspace;
+  frame->color_range = (AVColorRange)hdr.color_range;
+  frame->color_primaries = (AVColorPrimaries)hdr.color_primaries;
+  frame->color_trc = (AVColorTransferCharacteristic)hdr.color_trc;
+  frame->chroma_location = (AVChromaLocation)hdr.chroma_location;
+  frame->sample_aspect_ratio = {hdr.sar_num, hdr.sar_den};
+  frame->pts = hdr.pts;
+  frame->pkt_dts = hdr.pkt_dts;
+  frame->best_effort_timestamp = hdr.best_effort_timestamp;
+
+  int err = av_frame_get_buffer(frame, 0);
+  if (err < 0) throw Exception(err);
+
+  if (hdr.width > 0)
+  {
+    buf.resize(hdr.data_size);
+    if (std::fread(buf.data(), 1, buf.size(), file) != buf.size())
+      throw Exception("Failed to restore a frame from the temporary file.");
+
+    AVPixelFormat fmt = (AVPixelFormat)hdr.format;
+    uint8_t *src_data[4];
+    int src_linesize[4];
+    av_image_fill_arrays(src_data, src_linesize, buf.data(), fmt, hdr.width,
+                         hdr.height, 1);
+    av_image_copy(frame->data, frame->linesize, (const uint8_t **)src_data,
+                  src_linesize, fmt, hdr.width, hdr.height);
+  }
+  else
+  {
+    AVSampleFormat fmt = (AVSampleFormat)hdr.format;
+    int nplanes = av_sample_fmt_is_planar(fmt) ? hdr.channels : 1;
+    size_t plane_size = hdr.data_size / nplanes;
+    for (int i = 0; i < nplanes; ++i)
+      if (std::fread(frame->extended_data[i], 1, plane_size, file) !=
+          plane_size)
+        throw Exception("Failed to restore a frame from the temporary file.");
+  }
+
+  // rewind once drained, and reclaim the consumed space once it outgrows
+  // the backlog, so the file does not keep growing
+  if (--count)
+  {
+    rpos += sizeof(hdr) + hdr.data_size;
+    if (rpos >= min_compact_size && rpos >= wpos - rpos) compact();
+  }
+  else
+    rpos = wpos = 0;
+
+  return hdr.t;
+}
+
+void FrameSpill::compact()
+{
+  // copy forward in chunks: the destination always trails the source, so no
+  // unread byte is overwritten
+  std::vector<uint8_t> chunk((size_t)std::min(wpos - rpos, min_compact_size));
+  for (int64_t src = rpos, dst = 0; src < wpos;)
+  {
+    size_t n = (size_t)std::min<int64_t>(chunk.size(), wpos - src);
+    if (seek(file, src) || std::fread(chunk.data(), 1, n, file) != n ||
+        seek(file, dst) || std::fwrite(chunk.data(), 1, n, file) != n)
+      throw Exception("Failed to compact the spilled frames.");
+    src += n;
+    dst += n;
+  }
+  wpos -= rpos;
+  rpos = 0;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+extern "C"
+{
+#include <libavutil/frame.h>
+}
+
+namespace ffmpeg
+{
+
+/**
+ * \brief First-in-first-out store of AVFrames in an anonymous temporary file
+ *
+ * FrameSpill serializes the essential fields (timing, format & color
+ * properties) and the data planes of video and audio frames to a tmpfile() so that frames which do not fit in memory
+ * can be parked on disk and restored later in the same order. Each frame is
+ * stored with an accompanying timestamp in seconds. The file is rewound
+ * whenever it is drained, and the remaining frames are moved back to its
+ * start once the consumed space exceeds them (and min_compact_size), so the
+ * file stays within about twice the peak backlog even if it is never fully
+ * drained.
+ */
+class FrameSpill
+{
+  public:
+  FrameSpill() : file(nullptr), rpos(0), wpos(0), count(0) {}
+  FrameSpill(const FrameSpill &) = delete;
+  FrameSpill &operator=(const FrameSpill &) = delete;
+  FrameSpill(FrameSpill &&src)
+      : file(src.file), rpos(src.rpos), wpos(src.wpos), count(src.count)
+  {
+    src.file = nullptr;
+    src.count = 0;
+  }
+  ~FrameSpill()
+  {
+    if (file) std::fclose(file);
+  }
+
+  /**
+   * \brief Number of frames in the store
+   */
+  size_t size() const { return count; }
+  bool empty() const { return !count; }
+
+  /**
+   * \brief Append a frame at the end of the store
+   *
+   * \param[in] frame  Video or audio frame (left unchanged)
+   * \param[in] t      Timestamp of the frame in seconds
+   * \throws ffmpeg::Exception if the temporary file cannot be written
+   */
+  void push(const AVFrame *frame, const double t);
+
+  /**
+   * \brief Remove the first frame from the store
+   *
+   * \param[out] frame  Unreferenced AVFrame to receive the frame
+   * \returns Timestamp of the frame in seconds
+   * \throws ffmpeg::Exception if empty or the temporary file cannot be read
+   */
+  double pop(AVFrame *frame);
+
+  /**
+   * \brief Discard all the frames
+   */
+  void clear() { rpos = wpos = count = 0; }
+
+  private:
+  // move the frames [rpos, wpos) to the start of the file
+  void compact();
+
+  static constexpr int64_t min_compact_size = 1 << 20; // bytes
+
+  std::FILE *file;
+  int64_t rpos;  // file offset of the first frame
+  int64_t wpos;  // file offset of the end of the last frame
+  size_t count;
+  std::vector<uint8_t> buf; // (de)serialization buffer
+};
+
+} // namespace ffmpeg
@@ -0,0 +1,994 @@
+#include "ffmpegImageTranspose.h"
+
+extern "C"
+{
+#include <libavutil/pixdesc.h>
+}
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) ||           \
+    defined(_M_IX86)
+#define FFMPEG_TRANSPOSE_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define FFMPEG_TARGET_AVX2
+#else
+#define FFMPEG_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define FFMPEG_TRANSPOSE_NEON
+#include <arm_neon.h>
+#endif
+
+#include "ffmpegException.h"
+
+using namespace ffmpeg;
+
+namespace
+{
+
+// tile size: 3 planes of TILE x TILE bytes stay well within L1
+constexpr int TILE = 32;
+
+/////////////////////////////////////////////////////////////////////////////
+// YUV->RGB conversion coefficients (Q14 fixed point)
+
+struct YuvCoeffs
+{
+  int32_t y_off; // luma offset (16 for limited range)
+  int32_t cy;    // luma gain
+  int32_t crv;   // V contribution to R
+  int32_t cgu;   // U contribution to G (subtracted)
+  int32_t cgv;   // V contribution to G (subtracted)
+  int32_t cbu;   // U contribution to B
+};
+
+// luma coefficients of R & B
+void get_kr_kb(const AVColorSpace cs, double &kr, double &kb)
+{
+  switch (cs)
+  {
+  case AVCOL_SPC_BT709: kr = 0.2126, kb = 0.0722; break;
+  case AVCOL_SPC_BT2020_NCL:
+  case AVCOL_SPC_BT2020_CL: kr = 0.2627, kb = 0.0593; break;
+  case AVCOL_SPC_SMPTE240M: kr = 0.212, kb = 0.087; break;
+  default: kr = 0.299, kb = 0.114; // BT.601 (swscale default)
+  }
+}
+
+YuvCoeffs get_yuv_coeffs(const AVColorSpace cs, const bool full_range)
+{
+  double kr, kb;
+  get_kr_kb(cs, kr, kb);
+  double kg = 1.0 - kr - kb;
+  double ys = full_range ? 1.0 : 255.0 / 219.0;
+  double cs_ = full_range ? 1.0 : 255.0 / 224.0;
+  auto q14 = [](double v) { return (int32_t)std::lrint(v * (1 << 14)); };
+  return {full_range ? 0 : 16,
+          q14(ys),
+          q14(2.0 * (1.0 - kr) * cs_),
+          q14(2.0 * kb * (1.0 - kb) / kg * cs_),
+          q14(2.0 * kr * (1.0 - kr) / kg * cs_),
+          q14(2.0 * (1.0 - kb) * cs_)};
+}
+
+inline uint8_t clip_uint8(const int32_t v)
+{
+  return v < 0 ? 0 : v > 255 ? 255 : (uint8_t)v;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Row converters: n pixels of one image row to R, G, & B rows
+// (chroma samples are horizontally subsampled by 2^sx)
+
+void yuv_row_c(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+               const int sx, const int i0, const int n, uint8_t *r,
+               uint8_t *g, uint8_t *b, const YuvCoeffs &k)
+{
+  for (int i = i0; i < n; ++i)
+  {
+    int32_t Y = (y[i] - k.y_off) * k.cy + (1 << 13);
+    int32_t U = u[i >> sx] - 128;
+    int32_t V = v[i >> sx] - 128;
+    r[i] = clip_uint8((Y + k.crv * V) >> 14);
+    g[i] = clip_uint8((Y - k.cgu * U - k.cgv * V) >> 14);
+    b[i] = clip_uint8((Y + k.cbu * U) >> 14);
+  }
+}
+
+#if defined(FFMPEG_TRANSPOSE_X86)
+
+bool cpu_has_avx2()
+{
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 1);
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  if (!osxsave || (_xgetbv(0) & 6) != 6) return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  __builtin_cpu_init(); // may run ahead of libgcc's own initialization
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+// resolved on first use rather than by a static initializer
+bool use_avx2()
+{
+  static const bool avx2 = cpu_has_avx2();
+  return avx2;
+}
+
+FFMPEG_TARGET_AVX2 inline void store8_avx2(uint8_t *dst, const __m256i v)
+{
+  __m128i p = _mm_packs_epi32(_mm256_castsi256_si128(v),
+                              _mm256_extracti128_si256(v, 1));
+  _mm_storel_epi64((__m128i *)dst, _mm_packus_epi16(p, p));
+}
+
+// returns the number of pixels converted (multiple of 8)
+FFMPEG_TARGET_AVX2 int yuv_row_avx2(const uint8_t *y, const uint8_t *u,
+                                    const uint8_t *v, const int sx,
+                                    const int n, uint8_t *r, uint8_t *g,
+                                    uint8_t *b, const YuvCoeffs &k)
+{
+  if (sx > 1) return 0;
+
+  const __m256i yoff = _mm256_set1_epi32(k.y_off);
+  const __m256i c128 = _mm256_set1_epi32(128);
+  const __m256i rnd = _mm256_set1_epi32(1 << 13);
+  const __m256i cy = _mm256_set1_epi32(k.cy);
+  const __m256i crv = _mm256_set1_epi32(k.crv);
+  const __m256i cgu = _mm256_set1_epi32(k.cgu);
+  const __m256i cgv = _mm256_set1_epi32(k.cgv);
+  const __m256i cbu = _mm256_set1_epi32(k.cbu);
+  const __m256i dup = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256i Y = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(y + i)));
+    __m256i U, V;
+    if (sx)
+    {
+      int32_t u4, v4;
+      std::memcpy(&u4, u + (i >> 1), 4);
+      std::memcpy(&v4, v + (i >> 1), 4);
+      U = _mm256_permutevar8x32_epi32(
+          _mm256_cvtepu8_epi32(_mm_cvtsi32_si128(u4)), dup);
+      V = _mm256_permutevar8x32_epi32(
+          _mm256_cvtepu8_epi32(_mm_cvtsi32_si128(v4)), dup);
+    }
+    else
+    {
+      U = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(u + i)));
+      V = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(v + i)));
+    }
+    Y = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(Y, yoff), cy),
+                         rnd);
+    U = _mm256_sub_epi32(U, c128);
+    V = _mm256_sub_epi32(V, c128);
+
+    __m256i R = _mm256_add_epi32(Y, _mm256_mullo_epi32(V, crv));
+    __m256i G = _mm256_sub_epi32(
+        _mm256_sub_epi32(Y, _mm256_mullo_epi32(U, cgu)),
+        _mm256_mullo_epi32(V, cgv));
+    __m256i B = _mm256_add_epi32(Y, _mm256_mullo_epi32(U, cbu));
+
+    store8_avx2(r + i, _mm256_srai_epi32(R, 14));
+    store8_avx2(g + i, _mm256_srai_epi32(G, 14));
+    store8_avx2(b + i, _mm256_srai_epi32(B, 14));
+  }
+  return i;
+}
+
+#elif defined(FFMPEG_TRANSPOSE_NEON)
+
+inline uint8x8_t narrow8_neon(const int32x4_t lo, const int32x4_t hi)
+{
+  return vqmovun_s16(
+      vcombine_s16(vqmovn_s32(vshrq_n_s32(lo, 14)), vqmovn_s32(vshrq_n_s32(hi, 14))));
+}
+
+// returns the number of pixels converted (multiple of 8)
+int yuv_row_neon(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                 const int sx, const int n, uint8_t *r, uint8_t *g,
+                 uint8_t *b, const YuvCoeffs &k)
+{
+  if (sx > 1) return 0;
+
+  const int16x8_t yoff = vdupq_n_s16((int16_t)k.y_off);
+  const int16x8_t c128 = vdupq_n_s16(128);
+  const int32x4_t rnd = vdupq_n_s32(1 << 13);
+
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    uint8x8_t u8, v8;
+    if (sx)
+    {
+      uint32_t u4, v4;
+      std::memcpy(&u4, u + (i >> 1), 4);
+      std::memcpy(&v4, v + (i >> 1), 4);
+      uint8x8_t uu = vreinterpret_u8_u32(vdup_n_u32(u4));
+      uint8x8_t vv = vreinterpret_u8_u32(vdup_n_u32(v4));
+      u8 = vzip_u8(uu, uu).val[0];
+      v8 = vzip_u8(vv, vv).val[0];
+    }
+    else
+    {
+      u8 = vld1_u8(u + i);
+      v8 = vld1_u8(v + i);
+    }
+
+    int16x8_t Y16 = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(y + i))), yoff);
+    int16x8_t U16 = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u8)), c128);
+    int16x8_t V16 = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v8)), c128);
+
+    int32x4_t Ylo = vmlaq_n_s32(rnd, vmovl_s16(vget_low_s16(Y16)), k.cy);
+    int32x4_t Yhi = vmlaq_n_s32(rnd, vmovl_s16(vget_high_s16(Y16)), k.cy);
+    int32x4_t Ulo = vmovl_s16(vget_low_s16(U16));
+    int32x4_t Uhi = vmovl_s16(vget_high_s16(U16));
+    int32x4_t Vlo = vmovl_s16(vget_low_s16(V16));
+    int32x4_t Vhi = vmovl_s16(vget_high_s16(V16));
+
+    vst1_u8(r + i, narrow8_neon(vmlaq_n_s32(Ylo, Vlo, k.crv),
+                                vmlaq_n_s32(Yhi, Vhi, k.crv)));
+    vst1_u8(g + i,
+            narrow8_neon(vmlsq_n_s32(vmlsq_n_s32(Ylo, Ulo, k.cgu), Vlo, k.cgv),
+                         vmlsq_n_s32(vmlsq_n_s32(Yhi, Uhi, k.cgu), Vhi, k.cgv)));
+    vst1_u8(b + i, narrow8_neon(vmlaq_n_s32(Ylo, Ulo, k.cbu),
+                                vmlaq_n_s32(Yhi, Uhi, k.cbu)));
+  }
+  return i;
+}
+
+#endif
+
+inline void yuv_row(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                    const int sx, const int n, uint8_t *r, uint8_t *g,
+                    uint8_t *b, const YuvCoeffs &k)
+{
+  int i0 = 0;
+#if defined(FFMPEG_TRANSPOSE_X86)
+  if (use_avx2()) i0 = yuv_row_avx2(y, u, v, sx, n, r, g, b, k);
+#elif defined(FFMPEG_TRANSPOSE_NEON)
+  i0 = yuv_row_neon(y, u, v, sx, n, r, g, b, k);
+#endif
+  yuv_row_c(y, u, v, sx, i0, n, r, g, b, k);
+}
+
+// packed RGB row: component offsets of R, G, & B & pixel step
+void packed_row(const uint8_t *src, const int step, const int ir,
+                const int ig, const int ib, const int n, uint8_t *r,
+                uint8_t *g, uint8_t *b)
+{
+  for (int i = 0; i < n; ++i, src += step)
+  {
+    r[i] = src[ir];
+    g[i] = src[ig];
+    b[i] = src[ib];
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Tile writers
+
+// write TILE-strided tile (nrows x ncols) to column-major dst (ld = height)
+template <typename T>
+inline void write_tile(T *dst, const size_t ld, const T *tile,
+                       const int nrows, const int ncols)
+{
+  for (int i = 0; i < ncols; ++i, dst += ld)
+    for (int j = 0; j < nrows; ++j) dst[j] = tile[j * TILE + i];
+}
+
+// transpose a 16x16 block of bytes: interleaving rows i & i+8 four times
+// (a perfect shuffle per pass) turns rows into columns
+#if defined(FFMPEG_TRANSPOSE_X86)
+inline void transpose_block16(uint8_t *dst, const size_t ld,
+                              const uint8_t *src, const int linesize)
+{
+  __m128i r[16], t[16];
+  for (int i = 0; i < 16; ++i)
+    r[i] = _mm_loadu_si128((const __m128i *)(src + (size_t)i * linesize));
+  for (int pass = 0; pass < 4; ++pass)
+  {
+    for (int i = 0; i < 8; ++i)
+    {
+      t[2 * i] = _mm_unpacklo_epi8(r[i], r[i + 8]);
+      t[2 * i + 1] = _mm_unpackhi_epi8(r[i], r[i + 8]);
+    }
+    std::copy(t, t + 16, r);
+  }
+  for (int i = 0; i < 16; ++i)
+    _mm_storeu_si128((__m128i *)(dst + i * ld), r[i]);
+}
+#define FFMPEG_TRANSPOSE_BLOCK16
+#elif defined(FFMPEG_TRANSPOSE_NEON)
+inline void transpose_block16(uint8_t *dst, const size_t ld,
+                              const uint8_t *src, const int linesize)
+{
+  uint8x16_t r[16], t[16];
+  for (int i = 0; i < 16; ++i) r[i] = vld1q_u8(src + (size_t)i * linesize);
+  for (int pass = 0; pass < 4; ++pass)
+  {
+    for (int i = 0; i < 8; ++i)
+    {
+      uint8x16x2_t z = vzipq_u8(r[i], r[i + 8]);
+      t[2 * i] = z.val[0];
+      t[2 * i + 1] = z.val[1];
+    }
+    std::copy(t, t + 16, r);
+  }
+  for (int i = 0; i < 16; ++i) vst1q_u8(dst + i * ld, r[i]);
+}
+#define FFMPEG_TRANSPOSE_BLOCK16
+#endif
+
+// transpose a plane to column-major dst
+void transpose_plane(uint8_t *dst, const uint8_t *src, const int linesize,
+                     const int width, const int height)
+{
+  const size_t ld = height;
+  for (int y0 = 0; y0 < height; y0 += TILE)
+  {
+    int nrows = std::min(TILE, height - y0);
+    for (int x0 = 0; x0 < width; x0 += TILE)
+    {
+      int ncols = std::min(TILE, width - x0);
+      const uint8_t *s = src + (size_t)y0 * linesize + x0;
+      uint8_t *d = dst + x0 * ld + y0;
+#ifdef FFMPEG_TRANSPOSE_BLOCK16
+      if (nrows == TILE && ncols == TILE)
+      {
+        for (int j = 0; j < TILE; j += 16)
+          for (int i = 0; i < TILE; i += 16)
+            transpose_block16(d + i * ld + j, ld, s + (size_t)j * linesize + i,
+                              linesize);
+        continue;
+      }
+#endif
+      for (int i = 0; i < ncols; ++i, d += ld)
+        for (int j = 0; j < nrows; ++j) d[j] = s[(size_t)j * linesize + i];
+    }
+  }
+}
+
+struct PackedLayout
+{
+  AVPixelFormat fmt;
+  int step, ir, ig, ib;
+};
+
+const PackedLayout packed_layouts[] = {
+    {AV_PIX_FMT_RGB24, 3, 0, 1, 2}, {AV_PIX_FMT_BGR24, 3, 2, 1, 0},
+    {AV_PIX_FMT_RGBA, 4, 0, 1, 2},  {AV_PIX_FMT_RGB0, 4, 0, 1, 2},
+    {AV_PIX_FMT_BGRA, 4, 2, 1, 0},  {AV_PIX_FMT_BGR0, 4, 2, 1, 0},
+    {AV_PIX_FMT_ARGB, 4, 1, 2, 3},  {AV_PIX_FMT_0RGB, 4, 1, 2, 3},
+    {AV_PIX_FMT_ABGR, 4, 3, 2, 1},  {AV_PIX_FMT_0BGR, 4, 3, 2, 1}};
+
+const PackedLayout *find_packed_layout(const AVPixelFormat fmt)
+{
+  for (auto &layout : packed_layouts)
+    if (layout.fmt == fmt) return &layout;
+  return nullptr;
+}
+
+// planar 8-bit YUV (incl. semi-planar NV12/NV21)
+bool is_yuv8(const AVPixelFormat fmt)
+{
+  switch (fmt)
+  {
+  case AV_PIX_FMT_YUV420P:
+  case AV_PIX_FMT_YUVJ420P:
+  case AV_PIX_FMT_YUV422P:
+  case AV_PIX_FMT_YUVJ422P:
+  case AV_PIX_FMT_YUV444P:
+  case AV_PIX_FMT_YUVJ444P:
+  case AV_PIX_FMT_YUV440P:
+  case AV_PIX_FMT_YUVJ440P:
+  case AV_PIX_FMT_YUV411P:
+  case AV_PIX_FMT_NV12:
+  case AV_PIX_FMT_NV21: return true;
+  default: return false;
+  }
+}
+
+bool is_full_range(const AVFrame *frame)
+{
+  switch (frame->format)
+  {
+  case AV_PIX_FMT_YUVJ420P:
+  case AV_PIX_FMT_YUVJ422P:
+  case AV_PIX_FMT_YUVJ444P:
+  case AV_PIX_FMT_YUVJ440P: return true;
+  default: return frame->color_range == AVCOL_RANGE_JPEG;
+  }
+}
+
+void yuv_to_rgb(uint8_t *dst, const AVFrame *frame)
+{
+  const AVPixelFormat fmt = (AVPixelFormat)frame->format;
+  const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+  const int sx = desc->log2_chroma_w, sy = desc->log2_chroma_h;
+  const bool semiplanar = fmt == AV_PIX_FMT_NV12 || fmt == AV_PIX_FMT_NV21;
+  const int iu = fmt == AV_PIX_FMT_NV21 ? 1 : 0; // NV12/NV21 U offset
+
+  const YuvCoeffs k = get_yuv_coeffs(frame->colorspace, is_full_range(frame));
+
+  const int width = frame->width, height = frame->height;
+  const size_t ld = height, plane = (size_t)width * height;
+  uint8_t *dst_r = dst, *dst_g = dst + plane, *dst_b = dst + 2 * plane;
+
+  uint8_t r[TILE * TILE], g[TILE * TILE], b[TILE * TILE];
+  uint8_t ubuf[TILE], vbuf[TILE];
+
+  for (int y0 = 0; y0 < height; y0 += TILE)
+  {
+    int nrows = std::min(TILE, height - y0);
+    for (int x0 = 0; x0 < width; x0 += TILE)
+    {
+      int ncols = std::min(TILE, width - x0);
+      int nchroma = ((x0 + ncols - 1) >> sx) - (x0 >> sx) + 1;
+
+      // convert the tile row by row
+      for (int j = 0; j < nrows; ++j)
+      {
+        int yy = y0 + j, yc = yy >> sy;
+        const uint8_t *ys = frame->data[0] + (size_t)yy * frame->linesize[0] + x0;
+        const uint8_t *us, *vs;
+        if (semiplanar)
+        {
+          const uint8_t *uv = frame->data[1] + (size_t)yc * frame->linesize[1] +
+                              2 * (x0 >> sx);
+          for (int i = 0; i < nchroma; ++i)
+          {
+            ubuf[i] = uv[2 * i + iu];
+            vbuf[i] = uv[2 * i + 1 - iu];
+          }
+          us = ubuf;
+          vs = vbuf;
+        }
+        else
+        {
+          us = frame->data[1] + (size_t)yc * frame->linesize[1] + (x0 >> sx);
+          vs = frame->data[2] + (size_t)yc * frame->linesize[2] + (x0 >> sx);
+        }
+        yuv_row(ys, us, vs, sx, ncols, r + j * TILE, g + j * TILE,
+                b + j * TILE, k);
+      }
+
+      // then write it out column-wise
+      size_t offset = x0 * ld + y0;
+      write_tile(dst_r + offset, ld, r, nrows, ncols);
+      write_tile(dst_g + offset, ld, g, nrows, ncols);
+      write_tile(dst_b + offset, ld, b, nrows, ncols);
+    }
+  }
+}
+
+void packed_to_rgb(uint8_t *dst, const AVFrame *frame,
+                   const PackedLayout &layout)
+{
+  const int width = frame->width, height = frame->height;
+  const size_t ld = height, plane = (size_t)width * height;
+  uint8_t *dst_r = dst, *dst_g = dst + plane, *dst_b = dst + 2 * plane;
+
+  uint8_t r[TILE * TILE], g[TILE * TILE], b[TILE * TILE];
+
+  for (int y0 = 0; y0 < height; y0 += TILE)
+  {
+    int nrows = std::min(TILE, height - y0);
+    for (int x0 = 0; x0 < width; x0 += TILE)
+    {
+      int ncols = std::min(TILE, width - x0);
+      for (int j = 0; j < nrows; ++j)
+        packed_row(frame->data[0] + (size_t)(y0 + j) * frame->linesize[0] +
+                       x0 * layout.step,
+                   layout.step, layout.ir, layout.ig, layout.ib, ncols,
+                   r + j * TILE, g + j * TILE, b + j * TILE);
+
+      size_t offset = x0 * ld + y0;
+      write_tile(dst_r + offset, ld, r, nrows, ncols);
+      write_tile(dst_g + offset, ld, g, nrows, ncols);
+      write_tile(dst_b + offset, ld, b, nrows, ncols);
+    }
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// High-precision conversion to uint16 (0-65535) or float (0-1) components
+//
+// Source samples of any depth up to 16 bits are located via the pixel format
+// descriptor, so planar, semi-planar (e.g., P010), and packed formats share
+// one loader. Each tile row is unpacked to float, normalized (Y & RGB to
+// [0,1], U & V to [-0.5,0.5]), converted to RGB if YUV (AVX2 or NEON when
+// available), and stored as uint16 or float.
+
+struct YuvCoeffsF
+{
+  float crv, cgu, cgv, cbu;
+};
+
+// sample normalization of a component: value * scale + offset
+struct CompNorm
+{
+  float scale, offset;
+};
+
+// true if the first ncomp components of the source format can be loaded
+bool hp_source_supported(const AVPixelFormat fmt, const int ncomp)
+{
+  const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+  if (!desc || fmt == AV_PIX_FMT_XYZ12LE ||
+      desc->flags & (AV_PIX_FMT_FLAG_BE | AV_PIX_FMT_FLAG_PAL |
+                     AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_HWACCEL |
+                     AV_PIX_FMT_FLAG_BAYER | AV_PIX_FMT_FLAG_FLOAT))
+    return false;
+
+  // color (3) or grayscale (1) components, alpha ignored (grayscale may also
+  // be the luma of YUV)
+  int n = desc->nb_components - (desc->flags & AV_PIX_FMT_FLAG_ALPHA ? 1 : 0);
+  if (n != ncomp &&
+      !(ncomp == 1 && n == 3 && !(desc->flags & AV_PIX_FMT_FLAG_RGB)))
+    return false;
+  n = ncomp;
+
+  // byte-aligned 8-bit or 16-bit (LE) words holding 8 to 16 bits
+  for (int c = 0; c < n; ++c)
+  {
+    const AVComponentDescriptor &comp = desc->comp[c];
+    if (comp.depth == 8 ? comp.shift != 0
+                        : comp.depth < 8 || comp.depth > 16 ||
+                              comp.shift + comp.depth > 16 || comp.step % 2 ||
+                              comp.offset % 2)
+      return false;
+  }
+  return true;
+}
+
+// unpack n samples of a component row from pixel x0, normalized to float
+// (chroma samples are horizontally subsampled by 2^sx)
+void load_row(float *dst, const uint8_t *src, const AVComponentDescriptor &comp,
+              const int sx, const int x0, const int n, const CompNorm &k)
+{
+  src += comp.offset;
+  if (comp.depth > 8)
+  {
+    const unsigned mask = (1u << comp.depth) - 1;
+    for (int i = 0; i < n; ++i)
+    {
+      uint16_t v;
+      std::memcpy(&v, src + (size_t)((x0 + i) >> sx) * comp.step, 2);
+      dst[i] = ((v >> comp.shift) & mask) * k.scale + k.offset;
+    }
+  }
+  else
+    for (int i = 0; i < n; ++i)
+      dst[i] = src[(size_t)((x0 + i) >> sx) * comp.step] * k.scale + k.offset;
+}
+
+inline float clip_unit(const float v) { return v < 0.f ? 0.f : v > 1.f ? 1.f : v; }
+inline void store_unit(const float v, float &dst) { dst = clip_unit(v); }
+inline void store_unit(const float v, uint16_t &dst)
+{
+  dst = (uint16_t)std::lrint(clip_unit(v) * 65535.f);
+}
+
+template <typename T>
+void store_row(const float *src, const int i0, const int n, T *dst)
+{
+  for (int i = i0; i < n; ++i) store_unit(src[i], dst[i]);
+}
+
+template <typename T>
+void yuvf_row_c(const float *y, const float *u, const float *v, const int i0,
+                const int n, T *r, T *g, T *b, const YuvCoeffsF &k)
+{
+  for (int i = i0; i < n; ++i)
+  {
+    store_unit(y[i] + k.crv * v[i], r[i]);
+    store_unit(y[i] - k.cgu * u[i] - k.cgv * v[i], g[i]);
+    store_unit(y[i] + k.cbu * u[i], b[i]);
+  }
+}
+
+#if defined(FFMPEG_TRANSPOSE_X86)
+
+FFMPEG_TARGET_AVX2 inline void store8_avx2(float *dst, const __m256 v)
+{
+  _mm256_storeu_ps(dst, v);
+}
+
+FFMPEG_TARGET_AVX2 inline void store8_avx2(uint16_t *dst, const __m256 v)
+{
+  __m256i w = _mm256_cvtps_epi32(_mm256_mul_ps(v, _mm256_set1_ps(65535.f)));
+  _mm_storeu_si128((__m128i *)dst,
+                   _mm_packus_epi32(_mm256_castsi256_si128(w),
+                                    _mm256_extracti128_si256(w, 1)));
+}
+
+FFMPEG_TARGET_AVX2 inline __m256 clip8_avx2(const __m256 v)
+{
+  return _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()),
+                       _mm256_set1_ps(1.f));
+}
+
+// returns the number of samples stored (multiple of 8)
+template <typename T>
+FFMPEG_TARGET_AVX2 int store_row_avx2(const float *src, const int n, T *dst)
+{
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+    store8_avx2(dst + i, clip8_avx2(_mm256_loadu_ps(src + i)));
+  return i;
+}
+
+// returns the number of pixels converted (multiple of 8)
+template <typename T>
+FFMPEG_TARGET_AVX2 int yuvf_row_avx2(const float *y, const float *u,
+                                     const float *v, const int n, T *r, T *g,
+                                     T *b, const YuvCoeffsF &k)
+{
+  const __m256 crv = _mm256_set1_ps(k.crv);
+  const __m256 cgu = _mm256_set1_ps(k.cgu);
+  const __m256 cgv = _mm256_set1_ps(k.cgv);
+  const __m256 cbu = _mm256_set1_ps(k.cbu);
+
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256 Y = _mm256_loadu_ps(y + i);
+    __m256 U = _mm256_loadu_ps(u + i);
+    __m256 V = _mm256_loadu_ps(v + i);
+    store8_avx2(r + i, clip8_avx2(_mm256_add_ps(Y, _mm256_mul_ps(crv, V))));
+    store8_avx2(g + i, clip8_avx2(_mm256_sub_ps(
+                           _mm256_sub_ps(Y, _mm256_mul_ps(cgu, U)),
+                           _mm256_mul_ps(cgv, V))));
+    store8_avx2(b + i, clip8_avx2(_mm256_add_ps(Y, _mm256_mul_ps(cbu, U))));
+  }
+  return i;
+}
+
+#elif defined(FFMPEG_TRANSPOSE_NEON)
+
+inline void store4_neon(float *dst, const float32x4_t v) { vst1q_f32(dst, v); }
+
+inline void store4_neon(uint16_t *dst, const float32x4_t v)
+{
+  float32x4_t w = vmulq_n_f32(v, 65535.f);
+#if defined(__aarch64__)
+  uint32x4_t q = vcvtnq_u32_f32(w);
+#else
+  uint32x4_t q = vcvtq_u32_f32(vaddq_f32(w, vdupq_n_f32(0.5f)));
+#endif
+  vst1_u16(dst, vmovn_u32(q));
+}
+
+inline float32x4_t clip4_neon(const float32x4_t v)
+{
+  return vminq_f32(vmaxq_f32(v, vdupq_n_f32(0.f)), vdupq_n_f32(1.f));
+}
+
+// returns the number of samples stored (multiple of 4)
+template <typename T> int store_row_neon(const float *src, const int n, T *dst)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    store4_neon(dst + i, clip4_neon(vld1q_f32(src + i)));
+  return i;
+}
+
+// returns the number of pixels converted (multiple of 4)
+template <typename T>
+int yuvf_row_neon(const float *y, const float *u, const float *v,
+                  const int n, T *r, T *g, T *b, const YuvCoeffsF &k)
+{
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    float32x4_t Y = vld1q_f32(y + i);
+    float32x4_t U = vld1q_f32(u + i);
+    float32x4_t V = vld1q_f32(v + i);
+    store4_neon(r + i, clip4_neon(vmlaq_n_f32(Y, V, k.crv)));
+    store4_neon(g + i,
+                clip4_neon(vmlsq_n_f32(vmlsq_n_f32(Y, U, k.cgu), V, k.cgv)));
+    store4_neon(b + i, clip4_neon(vmlaq_n_f32(Y, U, k.cbu)));
+  }
+  return i;
+}
+
+#endif
+
+template <typename T> inline void store_row(const float *src, const int n, T *dst)
+{
+  int i0 = 0;
+#if defined(FFMPEG_TRANSPOSE_X86)
+  if (use_avx2()) i0 = store_row_avx2(src, n, dst);
+#elif defined(FFMPEG_TRANSPOSE_NEON)
+  i0 = store_row_neon(src, n, dst);
+#endif
+  store_row(src, i0, n, dst);
+}
+
+template <typename T>
+inline void yuvf_row(const float *y, const float *u, const float *v,
+                     const int n, T *r, T *g, T *b, const YuvCoeffsF &k)
+{
+  int i0 = 0;
+#if defined(FFMPEG_TRANSPOSE_X86)
+  if (use_avx2()) i0 = yuvf_row_avx2(y, u, v, n, r, g, b, k);
+#elif defined(FFMPEG_TRANSPOSE_NEON)
+  i0 = yuvf_row_neon(y, u, v, n, r, g, b, k);
+#endif
+  yuvf_row_c(y, u, v, i0, n, r, g, b, k);
+}
+
+// convert ncomp (1 or 3) components of a frame to column-major dst
+template <typename T>
+void hp_to_components(T *dst, const AVFrame *frame, const int ncomp)
+{
+  const AVPixelFormat fmt = (AVPixelFormat)frame->format;
+  const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+  const bool yuv = ncomp == 3 && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+  const int sx = desc->log2_chroma_w, sy = desc->log2_chroma_h;
+
+  // normalization of each component
+  CompNorm norm[3];
+  const bool full_range = is_full_range(frame);
+  for (int c = 0; c < ncomp; ++c)
+  {
+    int depth = desc->comp[c].depth;
+    float maxval = (float)((1 << depth) - 1);
+    if (!yuv) // RGB, grayscale, or luma as is
+      norm[c] = {1.f / maxval, 0.f};
+    else if (c == 0) // luma
+      norm[c] = full_range ? CompNorm{1.f / maxval, 0.f}
+                           : CompNorm{1.f / (219 << (depth - 8)),
+                                      -16.f / 219.f};
+    else // chroma
+    {
+      float s = full_range ? 1.f / maxval : 1.f / (224 << (depth - 8));
+      norm[c] = {s, -(float)(1 << (depth - 1)) * s};
+    }
+  }
+
+  YuvCoeffsF k = {};
+  if (yuv)
+  {
+    double kr, kb;
+    get_kr_kb(frame->colorspace, kr, kb);
+    double kg = 1.0 - kr - kb;
+    k = {(float)(2.0 * (1.0 - kr)), (float)(2.0 * kb * (1.0 - kb) / kg),
+         (float)(2.0 * kr * (1.0 - kr) / kg), (float)(2.0 * (1.0 - kb))};
+  }
+
+  const int width = frame->width, height = frame->height;
+  const size_t ld = height, plane = (size_t)width * height;
+
+  float row[3][TILE];
+  T tile[3][TILE * TILE];
+
+  for (int y0 = 0; y0 < height; y0 += TILE)
+  {
+    int nrows = std::min(TILE, height - y0);
+    for (int x0 = 0; x0 < width; x0 += TILE)
+    {
+      int ncols = std::min(TILE, width - x0);
+
+      // convert the tile row by row
+      for (int j = 0; j < nrows; ++j)
+      {
+        for (int c = 0; c < ncomp; ++c)
+        {
+          const AVComponentDescriptor &comp = desc->comp[c];
+          bool chroma = yuv && c > 0;
+          int yy = chroma ? (y0 + j) >> sy : y0 + j;
+          load_row(row[c],
+                   frame->data[comp.plane] +
+                       (size_t)yy * frame->linesize[comp.plane],
+                   comp, chroma ? sx : 0, x0, ncols, norm[c]);
+        }
+        if (yuv)
+          yuvf_row(row[0], row[1], row[2], ncols, tile[0] + j * TILE,
+                   tile[1] + j * TILE, tile[2] + j * TILE, k);
+        else
+          for (int c = 0; c < ncomp; ++c)
+            store_row(row[c], ncols, tile[c] + j * TILE);
+      }
+
+      // then write it out column-wise
+      size_t offset = x0 * ld + y0;
+      for (int c = 0; c < ncomp; ++c)
+        write_tile(dst + c * plane + offset, ld, tile[c], nrows, ncols);
+    }
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Component planes (raw samples at the native subsampling)
+
+// true if component c of the format is subsampled (YUV chroma)
+bool is_chroma(const AVPixFmtDescriptor *desc, const int c)
+{
+  return (c == 1 || c == 2) && desc->nb_components >= 3 &&
+         !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+}
+
+// transpose a (possibly interleaved) component into column-major dst
+template <typename T>
+void transpose_component(T *dst, const uint8_t *src, const int linesize,
+                         const AVComponentDescriptor &comp, const int width,
+                         const int height)
+{
+  const size_t ld = height;
+  const unsigned mask = (1u << comp.depth) - 1;
+  T tile[TILE * TILE];
+
+  for (int y0 = 0; y0 < height; y0 += TILE)
+  {
+    int nrows = std::min(TILE, height - y0);
+    for (int x0 = 0; x0 < width; x0 += TILE)
+    {
+      int ncols = std::min(TILE, width - x0);
+      for (int j = 0; j < nrows; ++j)
+      {
+        const uint8_t *s = src + (size_t)(y0 + j) * linesize + comp.offset +
+                           (size_t)x0 * comp.step;
+        T *t = tile + j * TILE;
+        for (int i = 0; i < ncols; ++i, s += comp.step)
+        {
+          if (sizeof(T) == 1)
+            t[i] = *s;
+          else
+          {
+            uint16_t v;
+            std::memcpy(&v, s, 2);
+            t[i] = (v >> comp.shift) & mask;
+          }
+        }
+      }
+      write_tile(dst + x0 * ld + y0, ld, tile, nrows, ncols);
+    }
+  }
+}
+
+// high-precision component buffer formats
+bool is_hp_dst(const AVPixelFormat fmt, int &ncomp)
+{
+  switch (fmt)
+  {
+  case AV_PIX_FMT_RGB48:
+  case AV_PIX_FMT_GBRPF32: ncomp = 3; return true;
+  case AV_PIX_FMT_GRAY16:
+  case AV_PIX_FMT_GRAYF32: ncomp = 1; return true;
+  default: return false;
+  }
+}
+
+} // namespace
+
+bool ffmpeg::imageTransposeSupported(const AVPixelFormat src_fmt,
+                                     const AVPixelFormat dst_fmt)
+{
+  if (dst_fmt == AV_PIX_FMT_RGB24)
+    return is_yuv8(src_fmt) || find_packed_layout(src_fmt) ||
+           src_fmt == AV_PIX_FMT_GBRP;
+  else if (dst_fmt == AV_PIX_FMT_GRAY8) // YUV: luma plane as is
+    return src_fmt == AV_PIX_FMT_GRAY8 || is_yuv8(src_fmt);
+  else if (int ncomp; is_hp_dst(dst_fmt, ncomp))
+    return hp_source_supported(src_fmt, ncomp);
+  return false;
+}
+
+size_t ffmpeg::imageTransposeGetBufferSize(const AVPixelFormat dst_fmt,
+                                           const int width, const int height)
+{
+  const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(dst_fmt);
+  size_t elsz = desc->flags & AV_PIX_FMT_FLAG_FLOAT ? 4
+                : desc->comp[0].depth > 8           ? 2
+                                                    : 1;
+  return (size_t)width * height * desc->nb_components * elsz;
+}
+
+void ffmpeg::imageTransposeToComponentBuffer(uint8_t *dst, const AVFrame *frame,
+                                             const AVPixelFormat dst_fmt)
+{
+  const AVPixelFormat src_fmt = (AVPixelFormat)frame->format;
+  if (!imageTransposeSupported(src_fmt, dst_fmt))
+    throw Exception("[ffmpeg::imageTransposeToComponentBuffer] Unsupported "
+                    "conversion (%s to %s).",
+                    av_get_pix_fmt_name(src_fmt), av_get_pix_fmt_name(dst_fmt));
+
+  const int width = frame->width, height = frame->height;
+  if (int ncomp; is_hp_dst(dst_fmt, ncomp))
+  {
+    if (dst_fmt == AV_PIX_FMT_GBRPF32 || dst_fmt == AV_PIX_FMT_GRAYF32)
+      hp_to_components((float *)dst, frame, ncomp);
+    else
+      hp_to_components((uint16_t *)dst, frame, ncomp);
+  }
+  else if (dst_fmt == AV_PIX_FMT_GRAY8)
+  {
+    transpose_plane(dst, frame->data[0], frame->linesize[0], width, height);
+  }
+  else if (src_fmt == AV_PIX_FMT_GBRP) // planes in G, B, R order
+  {
+    const size_t plane = (size_t)width * height;
+    transpose_plane(dst, frame->data[2], frame->linesize[2], width, height);
+    transpose_plane(dst + plane, frame->data[0], frame->linesize[0], width,
+                    height);
+    transpose_plane(dst + 2 * plane, frame->data[1], frame->linesize[1], width,
+                    height);
+  }
+  else if (auto layout = find_packed_layout(src_fmt))
+    packed_to_rgb(dst, frame, *layout);
+  else
+    yuv_to_rgb(dst, frame);
+}
+
+bool ffmpeg::imageTransposePlanesSupported(const AVPixelFormat fmt)
+{
+  const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+  if (!desc ||
+      desc->flags & (AV_PIX_FMT_FLAG_BE | AV_PIX_FMT_FLAG_PAL |
+                     AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_HWACCEL |
+                     AV_PIX_FMT_FLAG_BAYER | AV_PIX_FMT_FLAG_FLOAT))
+    return false;
+  for (int c = 0; c < desc->nb_components; ++c)
+  {
+    const AVComponentDescriptor &comp = desc->comp[c];
+    if (comp.depth == 8 ? comp.shift != 0
+                        : comp.depth < 8 || comp.depth > 16 ||
+                              comp.shift + comp.depth > 16 || comp.step % 2 ||
+                              comp.offset % 2)
+      return false;
+  }
+  return true;
+}
+
+void ffmpeg::imageTransposeGetPlaneSize(const AVPixelFormat fmt,
+                                        const int width, const int height,
+                                        const int c, int &w, int &h)
+{
+  const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+  if (is_chroma(desc, c))
+  {
+    w = (width + (1 << desc->log2_chroma_w) - 1) >> desc->log2_chroma_w;
+    h = (height + (1 << desc->log2_chroma_h) - 1) >> desc->log2_chroma_h;
+  }
+  else
+  {
+    w = width;
+    h = height;
+  }
+}
+
+void ffmpeg::imageTransposeComponentPlane(uint8_t *dst, const AVFrame *frame,
+                                          const int c)
+{
+  const AVPixelFormat fmt = (AVPixelFormat)frame->format;
+  if (!imageTransposePlanesSupported(fmt))
+    throw Exception("[ffmpeg::imageTransposeComponentPlane] Unsupported pixel "
+                    "format (%s).",
+                    av_get_pix_fmt_name(fmt));
+
+  const AVComponentDescriptor &comp = av_pix_fmt_desc_get(fmt)->comp[c];
+  int w, h;
+  imageTransposeGetPlaneSize(fmt, frame->width, frame->height, c, w, h);
+
+  const uint8_t *src = frame->data[comp.plane];
+  const int linesize = frame->linesize[comp.plane];
+  if (comp.depth > 8)
+    transpose_component((uint16_t *)dst, src, linesize, comp, w, h);
+  else if (comp.step == 1) // a plane of its own
+    transpose_plane(dst, src + comp.offset, linesize, w, h);
+  else
+    transpose_component(dst, src, linesize, comp, w, h);
+}
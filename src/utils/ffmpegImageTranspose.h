@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+extern "C"
+{
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+}
+
+namespace ffmpeg
+{
+
+/**
+ * \brief Check if a native convert-and-transpose path exists
+ *
+ * @param[in] src_fmt  pixel format of the frames to be converted
+ * @param[in] dst_fmt  pixel format of the component buffer
+ * @return true if imageTransposeToComponentBuffer() can convert src_fmt to
+ *         dst_fmt
+ */
+bool imageTransposeSupported(const AVPixelFormat src_fmt,
+                             const AVPixelFormat dst_fmt);
+
+/**
+ * \brief Returns the size in bytes of a transposed component buffer
+ *
+ * @param[in] dst_fmt  pixel format of the component buffer
+ * @param[in] width    the width of the source image in pixels
+ * @param[in] height   the height of the source image in pixels
+ * @return the buffer size in bytes
+ */
+size_t imageTransposeGetBufferSize(const AVPixelFormat dst_fmt,
+                                   const int width, const int height);
+
+/**
+ * \brief Convert and transpose an image into a component buffer in one pass
+ *
+ * imageTransposeToComponentBuffer() writes the image in frame into dst as a
+ * height-by-width-by-components column-major (MATLAB) array while converting
+ * its pixel format. This replaces the "transpose,format" filter graph
+ * followed by imageCopyToComponentBuffer(): the image is processed in small
+ * cache-resident tiles, which are converted row-wise (AVX2 or NEON when
+ * available) and written out column-wise.
+ *
+ * YUV frames are converted using the frame's colorspace (BT.601 if
+ * unspecified) and color range, following swscale's conventions.
+ * Grayscale (GRAY8, GRAY16, or GRAYF32) output of a YUV frame is its luma
+ * plane as is, transposed without any color conversion.
+ *
+ * Besides the 8-bit RGB24 & GRAY8, the component buffer may be RGB48 &
+ * GRAY16 (uint16, full 0-65535 scale) or GBRPF32 & GRAYF32 (float, 0-1
+ * scale). These high-precision outputs accept any little-endian RGB, YUV,
+ * or grayscale source with up to 16 bits per component (e.g.,
+ * yuv420p10le, p010le, or gbrp12le), so no precision is lost to an 8-bit
+ * intermediate.
+ *
+ * @param[out] dst      buffer of imageTransposeGetBufferSize() bytes
+ * @param[in]  frame    source image
+ * @param[in]  dst_fmt  pixel format of the component buffer
+ * @throws ffmpeg::Exception if the conversion is not supported
+ */
+void imageTransposeToComponentBuffer(uint8_t *dst, const AVFrame *frame,
+                                     const AVPixelFormat dst_fmt);
+
+/**
+ * \brief Check if the components of a pixel format can be transposed into
+ *        separate planes by imageTransposeComponentPlane()
+ *
+ * @param[in] fmt  pixel format of the frames
+ * @return true if every component is 8-bit or (little-endian) 9-16-bit
+ */
+bool imageTransposePlanesSupported(const AVPixelFormat fmt);
+
+/**
+ * \brief Returns the dimensions of a component plane
+ *
+ * The chroma planes of YUV formats are subsampled per the format; the other
+ * components are at full resolution.
+ *
+ * @param[in]  fmt     pixel format of the frames
+ * @param[in]  width   the width of the image in pixels
+ * @param[in]  height  the height of the image in pixels
+ * @param[in]  c       component index (per the format descriptor)
+ * @param[out] w       the width of the component plane
+ * @param[out] h       the height of the component plane
+ */
+void imageTransposeGetPlaneSize(const AVPixelFormat fmt, const int width,
+                                const int height, const int c, int &w, int &h);
+
+/**
+ * \brief Transpose a component of an image into its own plane
+ *
+ * The component samples are written without any conversion (raw values) as
+ * a h-by-w column-major array of uint8 (8-bit) or uint16 (9-16-bit)
+ * elements, regardless of whether the component is stored planar,
+ * semi-planar (e.g., NV12), or packed (e.g., YUYV422).
+ *
+ * @param[out] dst    buffer of w*h elements (see imageTransposeGetPlaneSize)
+ * @param[in]  frame  source image
+ * @param[in]  c      component index (per the format descriptor)
+ * @throws ffmpeg::Exception if the format is not supported
+ */
+void imageTransposeComponentPlane(uint8_t *dst, const AVFrame *frame,
+                                  const int c);
+
+} // namespace ffmpeg
@@ -0,0 +1,354 @@
+#include "ffmpegPacketIndex.h"
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#include "ffmpegException.h"
+
+using namespace ffmpeg;
+namespace fs = std::filesystem;
+
+namespace
+{
+
+// cache file layout (native byte order, checked via the magic number):
+//   header  magic, version, media size, media mtime, media path, start_time,
+//           nb_streams
+//   stream  time_base, nb_packets, pts[], dts[], pos[], key[] (uint8)
+constexpr uint64_t CACHE_MAGIC = 0x5844494f49464646ull; // "FFFIOIDX"
+constexpr uint32_t CACHE_VERSION = 1;
+
+// identity of the indexed media file
+struct MediaKey
+{
+  std::string path;
+  uint64_t size;
+  int64_t mtime;
+
+  explicit MediaKey(const std::string &url)
+  {
+    fs::path p = fs::canonical(url);
+    path = p.string();
+    size = fs::file_size(p);
+    mtime = fs::last_write_time(p).time_since_epoch().count();
+  }
+};
+
+// unique name of a temporary file next to path: several MATLAB sessions may
+// save the same cache file at once, so tag it with the process id & a
+// random number (the object address alone repeats across processes)
+std::string get_temp_path(const std::string &path)
+{
+  thread_local std::mt19937_64 rng(std::random_device{}());
+  return path + ".tmp" + std::to_string(getpid()) + "-" +
+         std::to_string(rng());
+}
+
+template <typename T> void write_value(std::ostream &os, const T &v)
+{
+  os.write((const char *)&v, sizeof(T));
+}
+template <typename T>
+void write_array(std::ostream &os, const std::vector<T> &v)
+{
+  os.write((const char *)v.data(), v.size() * sizeof(T));
+}
+template <typename T> bool read_value(std::istream &is, T &v)
+{
+  return (bool)is.read((char *)&v, sizeof(T));
+}
+template <typename T> bool read_array(std::istream &is, std::vector<T> &v)
+{
+  return (bool)is.read((char *)v.data(), v.size() * sizeof(T));
+}
+
+} // namespace
+
+void PacketIndex::build(const std::string &url)
+{
+  AVFormatContext *fmt_ctx = nullptr;
+  int err = avformat_open_input(&fmt_ctx, url.c_str(), nullptr, nullptr);
+  if (err < 0) throw Exception(err);
+  std::unique_ptr<AVFormatContext *, void (*)(AVFormatContext **)> fmt_cleanup(
+      &fmt_ctx, avformat_close_input);
+
+  err = avformat_find_stream_info(fmt_ctx, nullptr);
+  if (err < 0) throw Exception(err);
+
+  std::vector<Stream> new_streams(fmt_ctx->nb_streams);
+  for (unsigned i = 0; i < fmt_ctx->nb_streams; ++i)
+  {
+    AVStream *st = fmt_ctx->streams[i];
+    new_streams[i].time_base = st->time_base;
+    // cover art is not a part of the stream's frame sequence
+    if (st->disposition & AV_DISPOSITION_ATTACHED_PIC)
+      st->discard = AVDISCARD_ALL;
+  }
+
+  AVPacket *pkt = av_packet_alloc();
+  if (!pkt) throw Exception("Failed to allocate memory for an AVPacket.");
+  std::unique_ptr<AVPacket *, void (*)(AVPacket **)> pkt_cleanup(
+      &pkt, av_packet_free);
+
+  // last pts & duration per stream to extrapolate missing timestamps
+  std::vector<std::pair<int64_t, int64_t>> last(fmt_ctx->nb_streams,
+                                                {AV_NOPTS_VALUE, 0});
+  while ((err = av_read_frame(fmt_ctx, pkt)) >= 0)
+  {
+    if (fmt_ctx->streams[pkt->stream_index]->discard != AVDISCARD_ALL)
+    {
+      auto &prev = last[pkt->stream_index];
+      int64_t pts = pkt->pts;
+      if (pts == AV_NOPTS_VALUE) pts = pkt->dts;
+      if (pts == AV_NOPTS_VALUE)
+        pts = prev.first == AV_NOPTS_VALUE ? 0 : prev.first + prev.second;
+      prev = {pts, pkt->duration};
+
+      new_streams[pkt->stream_index].packets.push_back(
+          {pts, pkt->dts, pkt->pos, bool(pkt->flags & AV_PKT_FLAG_KEY)});
+    }
+    av_packet_unref(pkt);
+  }
+  if (err != AVERROR_EOF) throw Exception(err);
+
+  for (auto &s : new_streams) finalize(s);
+
+  start_time = fmt_ctx->start_time == AV_NOPTS_VALUE ? 0 : fmt_ctx->start_time;
+  streams = std::move(new_streams);
+}
+
+void PacketIndex::finalize(Stream &s)
+{
+  std::vector<std::pair<int64_t, bool>> frames;
+  frames.reserve(s.packets.size());
+  for (auto &pkt : s.packets) frames.emplace_back(pkt.pts, pkt.key);
+  std::stable_sort(
+      frames.begin(), frames.end(),
+      [](const auto &a, const auto &b) { return a.first < b.first; });
+
+  s.pts.resize(frames.size());
+  s.keys.clear();
+  for (size_t i = 0; i < frames.size(); ++i)
+  {
+    s.pts[i] = frames[i].first;
+    if (frames[i].second) s.keys.push_back(i);
+  }
+}
+
+const PacketIndex::Stream &PacketIndex::get_stream(const int st) const
+{
+  if (st < 0 || st >= (int)streams.size())
+    throw Exception("Stream #%d is not indexed.", st);
+  return streams[st];
+}
+
+size_t PacketIndex::getNumberOfFrames(const int st) const
+{
+  return get_stream(st).pts.size();
+}
+
+double PacketIndex::getFrameTime(const int st, const size_t n) const
+{
+  const Stream &s = get_stream(st);
+  if (n >= s.pts.size()) throw Exception("Frame index out of range.");
+  return s.pts[n] * av_q2d(s.time_base) - start_time / (double)AV_TIME_BASE;
+}
+
+size_t PacketIndex::getKeyFrame(const int st, const size_t n) const
+{
+  const Stream &s = get_stream(st);
+  auto it = std::upper_bound(s.keys.begin(), s.keys.end(), n);
+  return it == s.keys.begin() ? 0 : *(--it);
+}
+
+size_t PacketIndex::findFrame(const int st, const double t) const
+{
+  const Stream &s = get_stream(st);
+  int64_t pts = std::llround((t + start_time / (double)AV_TIME_BASE) /
+                             av_q2d(s.time_base));
+  auto it = std::upper_bound(s.pts.begin(), s.pts.end(), pts);
+  return it == s.pts.begin() ? 0 : (it - s.pts.begin()) - 1;
+}
+
+const std::vector<PacketIndex::Packet> &
+PacketIndex::getPackets(const int st) const
+{
+  return get_stream(st).packets;
+}
+
+AVRational PacketIndex::getTimeBase(const int st) const
+{
+  return get_stream(st).time_base;
+}
+
+bool PacketIndex::load(const std::string &cache_path, const std::string &url)
+{
+  std::ifstream is(cache_path, std::ios::binary | std::ios::ate);
+  if (!is) return false;
+  // bounds the array sizes read from a corrupt file
+  uint64_t file_size = (uint64_t)is.tellg();
+  is.seekg(0);
+
+  std::unique_ptr<MediaKey> key;
+  try
+  {
+    key = std::make_unique<MediaKey>(url);
+  }
+  catch (fs::filesystem_error &)
+  {
+    return false;
+  }
+
+  uint64_t magic, size;
+  uint32_t version, len;
+  int64_t mtime, t0;
+  if (!read_value(is, magic) || magic != CACHE_MAGIC ||
+      !read_value(is, version) || version != CACHE_VERSION ||
+      !read_value(is, size) || size != key->size || !read_value(is, mtime) ||
+      mtime != key->mtime || !read_value(is, len) || len != key->path.size())
+    return false;
+  std::string path(len, '\0');
+  if (!is.read(&path[0], len) || path != key->path) return false;
+
+  uint32_t nb_streams;
+  if (!read_value(is, t0) || !read_value(is, nb_streams) ||
+      nb_streams > file_size)
+    return false;
+
+  std::vector<Stream> new_streams(nb_streams);
+  for (auto &s : new_streams)
+  {
+    uint64_t n;
+    if (!read_value(is, s.time_base.num) || !read_value(is, s.time_base.den) ||
+        !read_value(is, n) || n > file_size / 25) // 25 bytes/packet
+      return false;
+
+    std::vector<int64_t> pts(n), dts(n), pos(n);
+    std::vector<uint8_t> keys(n);
+    if (!read_array(is, pts) || !read_array(is, dts) || !read_array(is, pos) ||
+        !read_array(is, keys))
+      return false;
+
+    s.packets.resize(n);
+    for (size_t i = 0; i < n; ++i)
+      s.packets[i] = {pts[i], dts[i], pos[i], bool(keys[i])};
+    finalize(s);
+  }
+
+  start_time = t0;
+  streams = std::move(new_streams);
+  return true;
+}
+
+void PacketIndex::save(const std::string &cache_path,
+                       const std::string &url) const
+{
+  if (empty()) throw Exception("Cannot save an empty packet index.");
+
+  std::unique_ptr<MediaKey> pkey;
+  try
+  {
+    pkey = std::make_unique<MediaKey>(url);
+  }
+  catch (fs::filesystem_error &e)
+  {
+    throw Exception("Failed to access the media file: %s", e.what());
+  }
+  const MediaKey &key = *pkey;
+
+  std::string tmp_path = get_temp_path(cache_path);
+  {
+    std::ofstream os(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!os)
+      throw Exception("Failed to create the index cache file: %s",
+                      tmp_path.c_str());
+
+    write_value(os, CACHE_MAGIC);
+    write_value(os, CACHE_VERSION);
+    write_value(os, key.size);
+    write_value(os, key.mtime);
+    write_value(os, (uint32_t)key.path.size());
+    os.write(key.path.data(), key.path.size());
+    write_value(os, start_time);
+    write_value(os, (uint32_t)streams.size());
+
+    for (auto &s : streams)
+    {
+      size_t n = s.packets.size();
+      write_value(os, s.time_base.num);
+      write_value(os, s.time_base.den);
+      write_value(os, (uint64_t)n);
+
+      // column-wise to keep the file free of struct padding
+      std::vector<int64_t> v(n);
+      std::transform(s.packets.begin(), s.packets.end(), v.begin(),
+                     [](const Packet &p) { return p.pts; });
+      write_array(os, v);
+      std::transform(s.packets.begin(), s.packets.end(), v.begin(),
+                     [](const Packet &p) { return p.dts; });
+      write_array(os, v);
+      std::transform(s.packets.begin(), s.packets.end(), v.begin(),
+                     [](const Packet &p) { return p.pos; });
+      write_array(os, v);
+      std::vector<uint8_t> keys(n);
+      std::transform(s.packets.begin(), s.packets.end(), keys.begin(),
+                     [](const Packet &p) { return (uint8_t)p.key; });
+      write_array(os, keys);
+    }
+
+    if (!os)
+    {
+      os.close();
+      std::remove(tmp_path.c_str());
+      throw Exception("Failed to write the index cache file: %s",
+                      tmp_path.c_str());
+    }
+  }
+
+  std::error_code ec;
+  fs::rename(tmp_path, cache_path, ec);
+  if (ec)
+  {
+    std::remove(tmp_path.c_str());
+    throw Exception("Failed to write the index cache file: %s",
+                    cache_path.c_str());
+  }
+}
+
+std::string PacketIndex::getCachePath(const std::string &url,
+                                      const std::string &cache_dir)
+{
+  if (cache_dir.empty()) return url + ".ffidx";
+
+  // FNV-1a hash of the canonical path keeps same-named files apart
+  std::error_code ec;
+  fs::path p = fs::weakly_canonical(url, ec);
+  if (ec) p = url;
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (char c : p.string()) h = (h ^ (uint8_t)c) * 0x100000001b3ull;
+
+  char hash[17];
+  std::snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)h);
+  return (fs::path(cache_dir) /
+          (p.filename().string() + "-" + hash + ".ffidx"))
+      .string();
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+extern "C"
+{
+#include <libavutil/rational.h>
+}
+
+namespace ffmpeg
+{
+
+/**
+ * \brief Packet/keyframe index of a media file
+ *
+ * PacketIndex runs a demux-only pass (no decoding) over a media file and
+ * records every packet of every stream. The packets are then sorted in
+ * presentation order so that frame numbers, frame times and the keyframe
+ * to seek to for any frame can be looked up in O(log n).
+ *
+ * Frame times are in seconds from the start of the file (i.e., the format
+ * start time is subtracted) to match the reader's timestamps.
+ *
+ * A built index can be saved to and reloaded from a compact binary cache
+ * file, which is keyed by the media file's canonical path, size and
+ * modification time so that a stale cache is never used.
+ */
+class PacketIndex
+{
+  public:
+  struct Packet
+  {
+    int64_t pts; // presentation timestamp (dts or extrapolated if unset)
+    int64_t dts; // decoding timestamp (AV_NOPTS_VALUE if unset)
+    int64_t pos; // byte offset in the file (-1 if unknown)
+    bool key;    // true if keyframe
+  };
+
+  PacketIndex() : start_time(0) {}
+
+  /**
+   * \brief Build the index from a full demux pass over the file
+   *
+   * \param[in] url   Path of the media file
+   * \throws ffmpeg::Exception if the file cannot be opened or demuxed
+   */
+  void build(const std::string &url);
+
+  /**
+   * \brief Load the index from a cache file
+   *
+   * \param[in] cache_path  Path of the cache file
+   * \param[in] url         Path of the media file
+   * \returns true if loaded, false if the cache file does not exist, is
+   *          corrupt, or was made for a different version of the media file
+   */
+  bool load(const std::string &cache_path, const std::string &url);
+
+  /**
+   * \brief Save the index to a cache file
+   *
+   * The file is written under a temporary name and renamed when complete, so
+   * concurrent readers never see a partial cache file.
+   *
+   * \param[in] cache_path  Path of the cache file
+   * \param[in] url         Path of the media file
+   * \throws ffmpeg::Exception if the index is empty or the file cannot be
+   *                           written
+   */
+  void save(const std::string &cache_path, const std::string &url) const;
+
+  /**
+   * \brief Returns the cache file path for a media file
+   *
+   * \param[in] url        Path of the media file
+   * \param[in] cache_dir  Cache directory. If empty, the cache file is a
+   *                       sidecar file next to the media file.
+   */
+  static std::string getCachePath(const std::string &url,
+                                  const std::string &cache_dir = "");
+
+  /**
+   * \brief Returns true if no index has been built
+   */
+  bool empty() const { return streams.empty(); }
+
+  /**
+   * \brief Returns the number of indexed streams (same as the file)
+   */
+  int getStreamCount() const { return (int)streams.size(); }
+
+  /**
+   * \brief Returns the number of frames (packets) of a stream
+   */
+  size_t getNumberOfFrames(const int st) const;
+
+  /**
+   * \brief Returns the time of the n-th frame (0-based, presentation order)
+   *        in seconds from the start of the file
+   */
+  double getFrameTime(const int st, const size_t n) const;
+
+  /**
+   * \brief Returns the frame index of the keyframe to seek to in order to
+   *        decode the n-th frame (the last keyframe presented at or before
+   *        it)
+   */
+  size_t getKeyFrame(const int st, const size_t n) const;
+
+  /**
+   * \brief Returns the index of the frame presented at time t (the last
+   *        frame with its time at or before t, 0 if t precedes all frames)
+   */
+  size_t findFrame(const int st, const double t) const;
+
+  /**
+   * \brief Returns the packets of a stream in the demuxing order
+   */
+  const std::vector<Packet> &getPackets(const int st) const;
+
+  /**
+   * \brief Returns the time base of a stream's timestamps
+   */
+  AVRational getTimeBase(const int st) const;
+
+  private:
+  struct Stream
+  {
+    AVRational time_base;
+    std::vector<Packet> packets; // demuxing order
+    std::vector<int64_t> pts;    // frame pts in presentation order
+    std::vector<size_t> keys;    // presentation-order indices of keyframes
+  };
+
+  const Stream &get_stream(const int st) const;
+  void finalize(Stream &s); // sort pts & locate keyframes
+
+  std::vector<Stream> streams;
+  int64_t start_time; // format start time in AV_TIME_BASE units
+};
+
+} // namespace ffmpeg
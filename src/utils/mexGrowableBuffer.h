@@ -0,0 +1,161 @@
+#pragma once
+
+#include <mex.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * \brief Growable column-major output buffer in MATLAB memory
+ *
+ * The buffer holds ncols columns of rows of elsz bytes each (e.g., an audio
+ * sample of a channel, or a whole rendered video frame) for an output whose
+ * final length is not exactly known in advance. Rows are appended to all the
+ * columns at once. When the capacity runs out it is (at least) doubled, so
+ * the content is moved O(log n) times instead of on every append.
+ *
+ * release() trims the unused capacity and hands the memory over to be
+ * adopted by an mxArray (mxSetData) without a copy. The memory is left
+ * uninitialized (mxMalloc/mxRealloc) as the appended rows are overwritten by
+ * the caller; only resize() zero-fills the rows it adds. It is not made
+ * persistent, so a buffer must not outlive the MEX call, and MATLAB reclaims
+ * it if the call is aborted by an error (which skips the destructor).
+ */
+class mexGrowableBuffer
+{
+  public:
+  mexGrowableBuffer() : data(nullptr), elsz(0), ncols(0), cap(0), nrows(0) {}
+  mexGrowableBuffer(const size_t elsz, const size_t ncols,
+                    const size_t capacity)
+      : data(nullptr)
+  {
+    reset(elsz, ncols, capacity);
+  }
+  ~mexGrowableBuffer()
+  {
+    if (data) mxFree(data);
+  }
+  mexGrowableBuffer(const mexGrowableBuffer &) = delete;
+  mexGrowableBuffer &operator=(const mexGrowableBuffer &) = delete;
+
+  /**
+   * \brief Discard the content and allocate a new (uninitialized) buffer
+   *
+   * \param[in] elsz      Number of bytes per row of a column
+   * \param[in] ncols     Number of columns
+   * \param[in] capacity  Initial number of rows (e.g., the expected length)
+   */
+  void reset(const size_t elsz, const size_t ncols, const size_t capacity)
+  {
+    if (data) mxFree(data);
+    data = nullptr;
+    this->elsz = elsz;
+    this->ncols = ncols;
+    cap = nrows = 0;
+    reserve(capacity);
+  }
+
+  /**
+   * \brief Number of rows appended so far
+   */
+  size_t size() const { return nrows; }
+
+  /**
+   * \brief Number of rows the columns can hold, i.e., the column length
+   *        (leading dimension) of the buffer
+   */
+  size_t capacity() const { return cap; }
+
+  /**
+   * \brief Returns the r-th row of the c-th column
+   */
+  uint8_t *row(const size_t r, const size_t c = 0)
+  {
+    return data + (c * cap + r) * elsz;
+  }
+
+  /**
+   * \brief Make room for n rows, moving the columns to their new offsets
+   */
+  void reserve(const size_t n)
+  {
+    if (n <= cap || !ncols || !elsz) return;
+    data = (uint8_t *)(data ? mxRealloc(data, n * ncols * elsz)
+                            : mxMalloc(n * ncols * elsz));
+    // last to first so none is overwritten
+    for (size_t c = ncols - 1; c > 0; --c)
+      std::memmove(data + c * n * elsz, data + c * cap * elsz, nrows * elsz);
+    cap = n;
+  }
+
+  /**
+   * \brief Append n rows, growing the buffer geometrically if needed
+   *
+   * \returns the first appended row of the first column (the others follow
+   *          capacity() rows apart)
+   */
+  uint8_t *append(const size_t n = 1)
+  {
+    if (nrows + n > cap) reserve(std::max(nrows + n, 2 * cap));
+    uint8_t *p = row(nrows);
+    nrows += n;
+    return p;
+  }
+
+  /**
+   * \brief Set the number of rows (added rows are zero-filled)
+   */
+  void resize(const size_t n)
+  {
+    reserve(n);
+    if (n > nrows)
+      for (size_t c = 0; c < ncols; ++c)
+        std::memset(row(nrows, c), 0, (n - nrows) * elsz);
+    nrows = n;
+  }
+
+  /**
+   * \brief Trim the unused capacity, moving the columns to their new offsets
+   */
+  void shrink_to_fit()
+  {
+    if (nrows == cap) return;
+    // first to last so none is overwritten
+    for (size_t c = 1; c < ncols; ++c)
+      std::memmove(data + c * nrows * elsz, data + c * cap * elsz,
+                   nrows * elsz);
+    if (nrows)
+    {
+      data = (uint8_t *)mxRealloc(data, nrows * ncols * elsz);
+    }
+    else
+    {
+      mxFree(data);
+      data = nullptr;
+    }
+    cap = nrows;
+  }
+
+  /**
+   * \brief Trim the buffer and hand its memory over (e.g., to mxSetData)
+   *
+   * \returns the nrows x ncols column-major data (nullptr if empty), no
+   *          longer owned by the buffer
+   */
+  uint8_t *release()
+  {
+    shrink_to_fit();
+    uint8_t *p = data;
+    data = nullptr;
+    cap = nrows = 0;
+    return p;
+  }
+
+  private:
+  uint8_t *data; // column-major buffer (owned until released)
+  size_t elsz;   // number of bytes per row of a column
+  size_t ncols;  // number of columns
+  size_t cap;    // number of rows allocated per column
+  size_t nrows;  // number of rows in use
+};
@@ -0,0 +1,24 @@
+% benchmark RGB output of video that needs the post-op conversion
+%   'rgb24': planar gbrp post-op + native transpose into the output planes
+%   'bgr24': packed post-op with transpose filter, deinterleaved on copy
+file = 'xylophone.mp4';
+filt = 'format=yuv420p10le'; % not natively convertible
+fmts = {'rgb24','bgr24'};
+N = 5;
+
+t = zeros(N,numel(fmts));
+for n = 1:N
+   for k = 1:numel(fmts)
+      vr = ffmpeg.Reader(file,'FilterGraph',filt,'VideoFormat',fmts{k});
+      tic
+      while vr.hasFrame()
+         vr.readBuffer();
+      end
+      t(n,k) = toc;
+      delete(vr);
+   end
+end
+
+for k = 1:numel(fmts)
+   fprintf('%s: median %.3f s (min %.3f s)\n',fmts{k},median(t(:,k)),min(t(:,k)));
+end
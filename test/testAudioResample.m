@@ -0,0 +1,13 @@
+% resampled audio keeps every sample: round(Nin*fs_out/fs_in), including the
+% resampler delay flushed at the end of the stream
+file = 'xylophone.mp4';
+[x,fs] = ffmpeg.audioread(file);
+fs_out = 16000;
+vr = ffmpeg.Reader(file,'Streams','a:0','SampleRate',fs_out,'AudioLayout','contiguous');
+y = [];
+while vr.hasFrame
+   y = [y; vr.readFrame()]; %#ok<AGROW>
+end
+delete(vr);
+assert(size(y,1)==round(size(x,1)*fs_out/fs), ...
+   'resampled %d samples, expected %d',size(y,1),round(size(x,1)*fs_out/fs));
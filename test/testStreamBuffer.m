@@ -0,0 +1,28 @@
+% 'error' secondary stream raises an error (not stall) when it is left unread
+vr = ffmpeg.Reader('xylophone.mp4','Streams',{'v:0','a:0'},'StreamBufferSize',2,'StreamBufferPolicy','error');
+try
+   while vr.hasFrame
+      v = vr.readFrame();
+   end
+   error('StreamBufferFull error was expected');
+catch ME
+   assert(strcmp(ME.identifier,'ffmpeg:Reader:StreamBufferFull'),ME.message);
+end
+delete(vr);
+
+% reading all the streams runs to the end
+vr = ffmpeg.Reader('xylophone.mp4','Streams',{'v:0','a:0'},'StreamBufferSize',2,'StreamBufferPolicy','error');
+n = 0;
+while vr.hasFrame
+   [v,a] = vr.readFrame();
+   n = n + 1;
+end
+assert(n>0);
+delete(vr);
+
+% 'drop-oldest' keeps an unread stream bounded without an error
+vr = ffmpeg.Reader('xylophone.mp4','Streams',{'v:0','a:0'},'StreamBufferSize',2,'StreamBufferPolicy','drop-oldest');
+while vr.hasFrame
+   v = vr.readFrame();
+end
+delete(vr);